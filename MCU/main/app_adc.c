@@ -36,6 +36,7 @@
 static const char *TAG = "app-adc";
 
 #define ADC_DETECT_VOLTAGE		2000	/* 2000mv */
+#define ADC_DETECT_PERIOD		10	/* 10ms */
 
 static esp_adc_cal_characteristics_t adc1_chars;
 static bool cali_enable = false;
@@ -86,3 +87,18 @@ bool app_adc_detect(void)
 {
 	return (bool)(app_adc_get_voltage() > ADC_DETECT_VOLTAGE);
 }
+
+/* Sample DET until it reaches the given state, false on timeout */
+bool app_adc_wait_detect(bool state, int timeout_ms)
+{
+	int elapsed = 0;
+
+	while (app_adc_detect() != state) {
+		if (elapsed >= timeout_ms)
+			return false;
+		vTaskDelay(ADC_DETECT_PERIOD / portTICK_PERIOD_MS);
+		elapsed += ADC_DETECT_PERIOD;
+	}
+
+	return true;
+}
@@ -35,6 +35,7 @@ extern "C" {
 void app_adc_init(void);
 int app_adc_get_voltage(void);
 bool app_adc_detect(void);
+bool app_adc_wait_detect(bool state, int timeout_ms);
 
 #ifdef __cplusplus
 }
@@ -23,10 +23,15 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <gitt_type.h>
+#include "esp_rom_crc.h"
 #include "app_gitt.h"
+#include "app_spiffs.h"
+#include "app_log.h"
+#include "app_task.h"
 
 static int app_gitt_get_date_impl(char *buf, uint8_t size)
 {
@@ -56,11 +61,88 @@ static void app_gitt_replace(char src, char tag, char *buf, int buf_size)
 		buf[i] = buf[i] == src ? tag : buf[i];
 }
 
+#define APP_GITT_SEEN_FRESH		600	/* s, events accepted on first boot */
+#define APP_GITT_SEEN_SKEW		3600	/* s, clock skew tolerated between devices */
+
+static uint32_t app_gitt_event_hash(struct gitt_device *device, char *date, char *event)
+{
+	uint32_t hash = 0;
+
+	hash = esp_rom_crc32_le(hash, (uint8_t *)device->id, strlen(device->id));
+	hash = esp_rom_crc32_le(hash, (uint8_t *)date, strlen(date));
+	hash = esp_rom_crc32_le(hash, (uint8_t *)event, strlen(event));
+
+	return hash;
+}
+
+/*
+ * Events are told apart by identity, not by order, so a command dated
+ * before one already handled, e.g. from a device whose clock runs
+ * behind, still runs. Only events that are older than the floor are
+ * assumed handled. The floor trails the entries evicted from the ring
+ * by APP_GITT_SEEN_SKEW, so that history replayed after a reconnect
+ * does not run again.
+ */
+static bool app_gitt_seen_find(struct app_gitt_seen *seen, uint32_t date, uint32_t hash)
+{
+	int i;
+
+	if (date < seen->floor)
+		return true;
+
+	for (i = 0; i < APP_GITT_SEEN_EVENTS; i++) {
+		if (seen->date[i] == date && seen->hash[i] == hash)
+			return true;
+	}
+
+	return false;
+}
+
+static void app_gitt_seen_add(struct app_gitt_seen *seen, uint32_t date, uint32_t hash,
+			      uint32_t now)
+{
+	uint32_t i = seen->head % APP_GITT_SEEN_EVENTS;
+	uint32_t evicted = seen->date[i];
+
+	/* An event dated in the future must not hide the commands still to come */
+	if (evicted > now)
+		evicted = now;
+	if (evicted > APP_GITT_SEEN_SKEW && evicted - APP_GITT_SEEN_SKEW > seen->floor)
+		seen->floor = evicted - APP_GITT_SEEN_SKEW;
+
+	seen->date[i] = date;
+	seen->hash[i] = hash;
+	seen->head = (i + 1) % APP_GITT_SEEN_EVENTS;
+}
+
+static void app_gitt_seen_load(struct app_gitt *app)
+{
+	/* Room for '\0' and one more byte, so that a longer file is noticed */
+	char buf[sizeof(struct app_gitt_seen) + 2];
+
+	/* A file of any other length is not ours, or was torn */
+	if (app_spiffs_load_atomic("seen", buf, sizeof(buf)) == sizeof(app->seen)) {
+		memcpy(&app->seen, buf, sizeof(app->seen));
+	} else {
+		/* Nothing handled yet, only take commands sent shortly before boot */
+		memset(&app->seen, 0, sizeof(app->seen));
+		app->seen.floor = time(NULL) - APP_GITT_SEEN_FRESH;
+		app->seen_changed = true;
+	}
+
+	app->seen_loaded = true;
+}
+
 static void app_gitt_remote_event_callback(struct gitt *g, struct gitt_device *device,
 					   char *date, char *zone, char *event)
 {
 	struct app_gitt *app = gitt_containerof(g, struct app_gitt, g);
+	uint32_t stamp = strtoul(date, NULL, 10);
+	uint32_t hash = app_gitt_event_hash(device, date, event);
 	int len = strlen(event);
+
+	if (app_gitt_seen_find(&app->seen, stamp, hash))
+		return;
 	// char buf[128];
 
 	// sprintf(buf, "%s <%s> %s %s: ", device->name, device->id, date, zone);
@@ -69,8 +151,14 @@ static void app_gitt_remote_event_callback(struct gitt *g, struct gitt_device *d
 	app_gitt_replace('\n', ' ', event, len);
 	// printf("%s\n", event);
 
-	if (app->callback)
-		app->callback(event);
+	/*
+	 * Only commands are remembered, the state reports of other devices
+	 * would rewrite the file on every poll and push commands out early
+	 */
+	if (app->callback && app->callback(event)) {
+		app_gitt_seen_add(&app->seen, stamp, hash, time(NULL));
+		app->seen_changed = true;
+	}
 }
 
 int app_gitt_init(struct app_gitt *app, app_gitt_recv call)
@@ -78,6 +166,8 @@ int app_gitt_init(struct app_gitt *app, app_gitt_recv call)
 	int ret = 0;
 
 	app->callback = call;
+	if (!app->seen_loaded)
+		app_gitt_seen_load(app);
 
 	/* Initialize */
 	app->g.privkey = app->privkey;
@@ -93,18 +183,33 @@ int app_gitt_init(struct app_gitt *app, app_gitt_recv call)
 	app->g.get_date = app_gitt_get_date_impl,
 	app->g.get_zone = app_gitt_get_zone_impl,
 
-	printf("Initialize...\n");
+	APP_LOG("Initialize...\n");
 	ret = gitt_init(&app->g);
-	printf("Initialize result: %s\n", GITT_ERRNO_STR(ret));
+	app_task_record_kex_stack();
+	APP_LOG("Initialize result: %s\n", GITT_ERRNO_STR(ret));
 	if (ret)
 		return ret;
 
-	printf("HEAD: %s\n", app->g.repository.head);
-	printf("Refs: %s\n", app->g.repository.refs);
+	APP_LOG_TEXT("HEAD: %s\n", app->g.repository.head);
+	APP_LOG_TEXT("Refs: %s\n", app->g.repository.refs);
 
 	/* Device info */
-	printf("Device name: %s\n", app->g.device.name);
-	printf("Device id:   %s\n", app->g.device.id);
+	APP_LOG_TEXT("Device name: %s\n", app->g.device.name);
+	APP_LOG_TEXT("Device id:   %s\n", app->g.device.id);
 
 	return 0;
 }
+
+/* Fetch new events, then persist how far they have been handled */
+int app_gitt_update(struct app_gitt *app)
+{
+	int ret;
+
+	ret = gitt_update_event(&app->g);
+
+	if (app->seen_changed &&
+	    !app_spiffs_save_atomic("seen", (char *)&app->seen, sizeof(app->seen)))
+		app->seen_changed = false;
+
+	return ret;
+}
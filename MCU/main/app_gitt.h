@@ -25,6 +25,8 @@
 #ifndef __APP_GITT_H_
 #define __APP_GITT_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <gitt.h>
 #include <gitt_errno.h>
 
@@ -32,7 +34,18 @@
 extern "C" {
 #endif /* __cplusplus */
 
-typedef void (*app_gitt_recv)(char *data);
+/* Return true if the event was a command for this device */
+typedef bool (*app_gitt_recv)(char *data);
+
+#define APP_GITT_SEEN_EVENTS		32
+
+/* Ring of the most recently handled remote events, identified by date and hash */
+struct app_gitt_seen {
+	uint32_t floor;		/* Events before this date left the ring long ago */
+	uint32_t head;		/* Next entry to overwrite */
+	uint32_t date[APP_GITT_SEEN_EVENTS];
+	uint32_t hash[APP_GITT_SEEN_EVENTS];
+};
 
 struct app_gitt {
 	struct gitt g;
@@ -45,9 +58,13 @@ struct app_gitt {
 	uint8_t buffer[4096];
 	uint8_t interval;
 	app_gitt_recv callback;
+	struct app_gitt_seen seen;	/* Persisted */
+	bool seen_changed;
+	bool seen_loaded;
 };
 
 int app_gitt_init(struct app_gitt *app, app_gitt_recv call);
+int app_gitt_update(struct app_gitt *app);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,434 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "app_adc.h"
+#include "app_history.h"
+
+static const char *TAG = "app-history";
+
+/*
+ * DET history, kept as a ring of fixed-size blocks in one SPIFFS file.
+ * Each entry is a varint time delta from the previous entry followed by
+ * one byte: bit 7 is the state, bits 0-6 the voltage in 200 mV steps.
+ * An entry is added when the state changes and every voltage period
+ * otherwise. The current block stays in RAM and is only written out when
+ * full or once per flush period, which bounds the flash writes per day.
+ */
+#define HISTORY_PATH			"/spiffs/history"
+#define HISTORY_MAGIC			0x4853
+#define HISTORY_BLOCKS			64
+#define HISTORY_BLOCK_DATA		240
+#define HISTORY_SAMPLE_PERIOD		2	/* s, DET polling */
+#define HISTORY_VOLTAGE_PERIOD		600	/* s */
+#define HISTORY_FLUSH_PERIOD		3600	/* s */
+#define HISTORY_GAP			(HISTORY_VOLTAGE_PERIOD * 2)	/* Longer gaps are unknown */
+#define HISTORY_VOLTAGE_STEP		200	/* mV */
+#define HISTORY_TIME_VALID		1600000000
+#define HISTORY_DAY			(24 * 3600)
+
+struct app_history_block {
+	uint16_t magic;
+	uint16_t len;
+	uint32_t seq;
+	uint32_t time;			/* Time of the first entry */
+	uint32_t crc;
+	uint8_t data[HISTORY_BLOCK_DATA];
+};
+
+struct app_history_stat {
+	uint32_t start;
+	uint32_t end;
+	uint32_t on;
+	uint32_t known;
+	uint32_t last_time;
+	bool last_state;
+	bool has_last;
+	int transitions;
+	bool print;
+};
+
+typedef void (*app_history_visit)(uint32_t time, bool state, int mv, void *arg);
+
+static struct app_history_block history_block;
+static uint32_t history_last;		/* Time of the last entry in history_block */
+static bool history_dirty;
+static SemaphoreHandle_t history_lock;
+
+static char history_summary[64];
+static bool history_summary_pending;
+
+static uint32_t app_history_crc(struct app_history_block *block)
+{
+	uint32_t crc = block->crc;
+	uint32_t ret;
+
+	block->crc = 0;
+	ret = esp_rom_crc32_le(0, (const uint8_t *)block, sizeof(*block));
+	block->crc = crc;
+
+	return ret;
+}
+
+static bool app_history_read(uint32_t slot, struct app_history_block *block)
+{
+	FILE *f;
+	int ret;
+
+	f = fopen(HISTORY_PATH, "rb");
+	if (f == NULL)
+		return false;
+
+	ret = fseek(f, slot * sizeof(*block), SEEK_SET);
+	if (!ret)
+		ret = fread(block, sizeof(*block), 1, f) != 1;
+	fclose(f);
+
+	return !ret && block->magic == HISTORY_MAGIC && block->crc == app_history_crc(block) &&
+	       block->len <= HISTORY_BLOCK_DATA;
+}
+
+static void app_history_write(struct app_history_block *block)
+{
+	FILE *f;
+
+	block->crc = app_history_crc(block);
+
+	f = fopen(HISTORY_PATH, "r+b");
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", HISTORY_PATH);
+		return;
+	}
+
+	if (fseek(f, (block->seq % HISTORY_BLOCKS) * sizeof(*block), SEEK_SET) ||
+	    fwrite(block, sizeof(*block), 1, f) != 1)
+		ESP_LOGE(TAG, "Block write failed");
+	fclose(f);
+}
+
+/* Caller holds history_lock */
+static void app_history_append(uint32_t now, bool state, int mv)
+{
+	uint8_t entry[6];
+	uint32_t delta;
+	int len = 0;
+
+	if (!history_block.len)
+		history_block.time = now;
+	delta = now - (history_block.len ? history_last : history_block.time);
+
+	/* The block is full, write it out and start the next one */
+	if (history_block.len + sizeof(entry) > HISTORY_BLOCK_DATA) {
+		app_history_write(&history_block);
+		history_block.seq++;
+		history_block.len = 0;
+		history_block.time = now;
+		delta = 0;
+	}
+
+	do {
+		entry[len++] = (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0);
+		delta >>= 7;
+	} while (delta);
+
+	mv /= HISTORY_VOLTAGE_STEP;
+	entry[len++] = (state ? 0x80 : 0) | (mv > 0x7f ? 0x7f : mv);
+
+	memcpy(history_block.data + history_block.len, entry, len);
+	history_block.len += len;
+	history_last = now;
+	history_dirty = true;
+}
+
+static void app_history_decode(const struct app_history_block *block, app_history_visit visit, void *arg)
+{
+	uint32_t time = block->time;
+	uint32_t delta;
+	int shift;
+	int i = 0;
+
+	while (i < block->len) {
+		delta = 0;
+		shift = 0;
+		while (i < block->len && shift < 32) {
+			delta |= (uint32_t)(block->data[i] & 0x7f) << shift;
+			shift += 7;
+			if (!(block->data[i++] & 0x80))
+				break;
+		}
+		if (i >= block->len)
+			break;
+
+		time += delta;
+		visit(time, block->data[i] & 0x80, (block->data[i] & 0x7f) * HISTORY_VOLTAGE_STEP, arg);
+		i++;
+	}
+}
+
+/* Visit all entries, oldest first */
+static void app_history_walk(app_history_visit visit, void *arg)
+{
+	struct app_history_block block;
+	uint32_t current;
+	uint32_t first;
+	uint32_t seq;
+
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+	current = history_block.seq;
+	xSemaphoreGive(history_lock);
+
+	first = current > HISTORY_BLOCKS - 1 ? current - (HISTORY_BLOCKS - 1) : 0;
+	for (seq = first; seq != current; seq++) {
+		if (app_history_read(seq % HISTORY_BLOCKS, &block) && block.seq == seq)
+			app_history_decode(&block, visit, arg);
+	}
+
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+	memcpy(&block, &history_block, sizeof(block));
+	xSemaphoreGive(history_lock);
+	app_history_decode(&block, visit, arg);
+}
+
+static void app_history_account(struct app_history_stat *st, uint32_t time)
+{
+	uint32_t from;
+	uint32_t to;
+
+	if (!st->has_last || time - st->last_time > HISTORY_GAP)
+		return;
+
+	from = st->last_time > st->start ? st->last_time : st->start;
+	to = time < st->end ? time : st->end;
+	if (to <= from)
+		return;
+
+	st->known += to - from;
+	if (st->last_state)
+		st->on += to - from;
+}
+
+static void app_history_stat_visit(uint32_t time, bool state, int mv, void *arg)
+{
+	struct app_history_stat *st = arg;
+	time_t t = time;
+	struct tm tm;
+
+	app_history_account(st, time);
+
+	if (st->has_last && state != st->last_state && time >= st->start && time < st->end) {
+		st->transitions++;
+		if (st->print) {
+			localtime_r(&t, &tm);
+			printf("%02d:%02d:%02d  %-3s  %d mV\n", tm.tm_hour, tm.tm_min, tm.tm_sec,
+			       state ? "ON" : "OFF", mv);
+		}
+	}
+
+	st->last_time = time;
+	st->last_state = state;
+	st->has_last = true;
+}
+
+static void app_history_stat(struct app_history_stat *st, uint32_t start, bool print)
+{
+	memset(st, 0, sizeof(*st));
+	st->start = start;
+	st->end = start + HISTORY_DAY;
+	st->print = print;
+
+	app_history_walk(app_history_stat_visit, st);
+	/* The state holds from the last entry up to now */
+	app_history_account(st, time(NULL));
+}
+
+static uint32_t app_history_day_start(time_t day)
+{
+	struct tm tm;
+
+	localtime_r(&day, &tm);
+	tm.tm_hour = 0;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+
+	return mktime(&tm);
+}
+
+void app_history_show(time_t day)
+{
+	struct app_history_stat st;
+	struct tm tm;
+
+	day = app_history_day_start(day);
+	localtime_r(&day, &tm);
+
+	printf("History of %04d/%02d/%02d:\n", 1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday);
+	app_history_stat(&st, day, true);
+	printf("Transitions : %d\n", st.transitions);
+	if (st.known)
+		printf("Uptime      : %u.%u%% of %u known seconds\n", (uint32_t)((uint64_t)st.on * 100 / st.known),
+		       (uint32_t)((uint64_t)st.on * 1000 / st.known % 10), st.known);
+	else
+		printf("Uptime      : unknown\n");
+}
+
+/* Copy the summary of the previous day, return false if there is none to push */
+bool app_history_summary(char *buf, int size)
+{
+	bool pending;
+
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+	pending = history_summary_pending;
+	if (pending)
+		snprintf(buf, size, "%s", history_summary);
+	xSemaphoreGive(history_lock);
+
+	return pending;
+}
+
+/* The summary has been pushed, unless a newer one was made meanwhile */
+void app_history_summary_done(const char *summary)
+{
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+	if (!strcmp(summary, history_summary))
+		history_summary_pending = false;
+	xSemaphoreGive(history_lock);
+}
+
+static void app_history_summarize(uint32_t day)
+{
+	struct app_history_stat st;
+	time_t t = day;
+	struct tm tm;
+
+	app_history_stat(&st, day, false);
+	if (!st.known)
+		return;
+
+	localtime_r(&t, &tm);
+	xSemaphoreTake(history_lock, portMAX_DELAY);
+	sprintf(history_summary, "SUMMARY %04d/%02d/%02d ON %u.%u%% TRANSITIONS %d",
+		1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday,
+		(uint32_t)((uint64_t)st.on * 100 / st.known),
+		(uint32_t)((uint64_t)st.on * 1000 / st.known % 10), st.transitions);
+	history_summary_pending = true;
+	xSemaphoreGive(history_lock);
+}
+
+static void app_history_task(void *pvParameters)
+{
+	uint32_t now;
+	uint32_t last_flush = 0;
+	uint32_t today = 0;
+	bool last_state = false;
+	bool state;
+	int mv;
+
+	while (1) {
+		vTaskDelay(HISTORY_SAMPLE_PERIOD * 1000 / portTICK_PERIOD_MS);
+
+		now = time(NULL);
+		if (now < HISTORY_TIME_VALID)
+			continue;
+
+		mv = app_adc_get_voltage();
+		state = app_adc_detect();
+
+		xSemaphoreTake(history_lock, portMAX_DELAY);
+		if (!history_block.len || state != last_state ||
+		    now - history_last >= HISTORY_VOLTAGE_PERIOD)
+			app_history_append(now, state, mv);
+
+		if (history_dirty && now - last_flush >= HISTORY_FLUSH_PERIOD) {
+			app_history_write(&history_block);
+			history_dirty = false;
+			last_flush = now;
+		}
+		xSemaphoreGive(history_lock);
+		last_state = state;
+
+		/* A day has passed, prepare the summary of the previous one */
+		if (app_history_day_start(now) != today) {
+			if (today)
+				app_history_summarize(today);
+			today = app_history_day_start(now);
+		}
+	}
+}
+
+void app_history_init(void)
+{
+	struct app_history_block block;
+	FILE *f;
+	uint32_t slot;
+	bool found = false;
+
+	history_lock = xSemaphoreCreateMutex();
+	ESP_ERROR_CHECK(history_lock == NULL);
+
+	/* Create the ring file with all blocks invalid */
+	f = fopen(HISTORY_PATH, "rb");
+	if (f == NULL) {
+		memset(&block, 0, sizeof(block));
+		f = fopen(HISTORY_PATH, "wb");
+		if (f == NULL) {
+			ESP_LOGE(TAG, "Failed to create %s", HISTORY_PATH);
+			return;
+		}
+		for (slot = 0; slot < HISTORY_BLOCKS; slot++)
+			fwrite(&block, sizeof(block), 1, f);
+	}
+	fclose(f);
+
+	/* Continue with the newest block */
+	memset(&history_block, 0, sizeof(history_block));
+	history_block.magic = HISTORY_MAGIC;
+	for (slot = 0; slot < HISTORY_BLOCKS; slot++) {
+		if (app_history_read(slot, &block) && (!found || block.seq > history_block.seq)) {
+			memcpy(&history_block, &block, sizeof(block));
+			found = true;
+		}
+	}
+
+	if (found && history_block.len) {
+		struct app_history_stat st = { 0 };
+
+		/* Recover the time of the last entry */
+		app_history_decode(&history_block, app_history_stat_visit, &st);
+		history_last = st.last_time;
+	}
+
+	ESP_LOGI(TAG, "History block: %u", history_block.seq);
+
+	xTaskCreate(app_history_task, "app_history_task", 1024 * 3, NULL, 2, NULL);
+}
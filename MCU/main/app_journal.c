@@ -0,0 +1,257 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "app_spiffs.h"
+#include "app_journal.h"
+
+static const char *TAG = "app-journal";
+
+/*
+ * Events that could not be pushed are appended to a ring of segment
+ * files. Each segment is only ever appended to, and is truncated when
+ * the ring wraps around to it, so writes rotate over all segments.
+ * The sequence number of the last pushed record is kept in "journal.ack".
+ */
+#define JOURNAL_MAGIC			0x4a52
+#define JOURNAL_SEGMENTS		4
+#define JOURNAL_SEGMENT_RECORDS		16
+#define JOURNAL_RECORDS			(JOURNAL_SEGMENTS * JOURNAL_SEGMENT_RECORDS)
+#define JOURNAL_EVENT_SIZE		16
+#define JOURNAL_BATCH			32	/* Records per commit, keeps within g.buf */
+#define JOURNAL_LINE_SIZE		(JOURNAL_EVENT_SIZE + 16)
+
+struct app_journal_record {
+	uint16_t magic;
+	uint16_t reserved;
+	uint32_t seq;
+	uint32_t time;
+	char event[JOURNAL_EVENT_SIZE];
+	uint32_t crc;
+};
+
+static uint32_t journal_ack = 0;	/* Last record committed to the repository */
+static uint32_t journal_next = 1;	/* Sequence number of the next record */
+static SemaphoreHandle_t journal_lock;	/* Appended from the LAN and schedule tasks too */
+
+static uint32_t app_journal_crc(const struct app_journal_record *rec)
+{
+	return esp_rom_crc32_le(0, (const uint8_t *)rec, offsetof(struct app_journal_record, crc));
+}
+
+static void app_journal_path(char *path, int segment)
+{
+	sprintf(path, "/spiffs/journal.%d", segment);
+}
+
+/* Read valid records of one segment, return the number of records */
+static int app_journal_read(int segment, struct app_journal_record *recs, int max)
+{
+	char path[32];
+	FILE *f;
+	int count = 0;
+
+	app_journal_path(path, segment);
+	f = fopen(path, "rb");
+	if (f == NULL)
+		return 0;
+
+	while (count < max && fread(&recs[count], sizeof(recs[count]), 1, f) == 1) {
+		/* A torn write at the end or a corrupted record is skipped */
+		if (recs[count].magic != JOURNAL_MAGIC ||
+		    recs[count].crc != app_journal_crc(&recs[count]))
+			continue;
+		count++;
+	}
+	fclose(f);
+
+	return count;
+}
+
+/* Load all records not yet committed, ordered by sequence number */
+static int app_journal_load(struct app_journal_record *recs)
+{
+	struct app_journal_record tmp;
+	int count = 0;
+	int segment;
+	int i, j, n;
+
+	for (segment = 0; segment < JOURNAL_SEGMENTS; segment++) {
+		n = app_journal_read(segment, recs + count, JOURNAL_SEGMENT_RECORDS);
+		for (i = 0, j = count; i < n; i++) {
+			if (recs[count + i].seq > journal_ack)
+				recs[j++] = recs[count + i];
+		}
+		count = j;
+	}
+
+	/* Insertion sort, the segments are already sorted */
+	for (i = 1; i < count; i++) {
+		tmp = recs[i];
+		for (j = i; j > 0 && recs[j - 1].seq > tmp.seq; j--)
+			recs[j] = recs[j - 1];
+		recs[j] = tmp;
+	}
+
+	return count;
+}
+
+int app_journal_append(const char *event)
+{
+	struct app_journal_record rec = {
+		.magic = JOURNAL_MAGIC,
+		.time = (uint32_t)time(NULL),
+	};
+	char path[32];
+	FILE *f;
+	int ret;
+
+	strncpy(rec.event, event, sizeof(rec.event) - 1);
+
+	xSemaphoreTake(journal_lock, portMAX_DELAY);
+	rec.seq = journal_next;
+	rec.crc = app_journal_crc(&rec);
+
+	/* Start of a segment: truncate it, dropping the oldest records */
+	app_journal_path(path, (rec.seq / JOURNAL_SEGMENT_RECORDS) % JOURNAL_SEGMENTS);
+	f = fopen(path, rec.seq % JOURNAL_SEGMENT_RECORDS ? "ab" : "wb");
+	if (f == NULL) {
+		xSemaphoreGive(journal_lock);
+		ESP_LOGE(TAG, "Failed to open %s", path);
+		return -1;
+	}
+
+	ret = fwrite(&rec, sizeof(rec), 1, f);
+	fclose(f);
+	if (ret != 1) {
+		xSemaphoreGive(journal_lock);
+		ESP_LOGE(TAG, "Record write failed");
+		return -1;
+	}
+
+	journal_next++;
+	xSemaphoreGive(journal_lock);
+	ESP_LOGD(TAG, "Journaled #%u: %s", rec.seq, rec.event);
+
+	return 0;
+}
+
+int app_journal_pending(void)
+{
+	return journal_next - 1 - journal_ack;
+}
+
+/* Push pending records as a single commit, oldest first */
+int app_journal_flush(app_journal_commit commit)
+{
+	struct app_journal_record *recs;
+	char ack[12];
+	char *message;
+	int count;
+	int len = 0;
+	int ret;
+	int i;
+
+	recs = malloc(JOURNAL_RECORDS * sizeof(*recs));
+	message = malloc(JOURNAL_BATCH * JOURNAL_LINE_SIZE);
+	if (!recs || !message) {
+		ESP_LOGE(TAG, "No memory for flush");
+		ret = -1;
+		goto out;
+	}
+
+	/* Appends may go on while the commit runs, they get higher sequence numbers */
+	xSemaphoreTake(journal_lock, portMAX_DELAY);
+	count = app_journal_load(recs);
+	if (!count) {
+		/* Everything pending was lost to wrap-around or corruption */
+		journal_ack = journal_next - 1;
+		ret = 0;
+		goto save;
+	}
+	xSemaphoreGive(journal_lock);
+	if (count > JOURNAL_BATCH)
+		count = JOURNAL_BATCH;
+
+	for (i = 0; i < count; i++)
+		len += sprintf(message + len, "%s @%u\n", recs[i].event, recs[i].time);
+	message[len - 1] = '\0';
+
+	ret = commit(message);
+	if (ret)
+		goto out;
+
+	xSemaphoreTake(journal_lock, portMAX_DELAY);
+	journal_ack = recs[count - 1].seq;
+	ESP_LOGD(TAG, "Flushed %d records", count);
+save:
+	/* A lost ack would push every stored record again */
+	sprintf(ack, "%u", journal_ack);
+	app_spiffs_save_atomic("journal.ack", ack, strlen(ack));
+	xSemaphoreGive(journal_lock);
+out:
+	free(recs);
+	free(message);
+	return ret;
+}
+
+void app_journal_init(void)
+{
+	struct app_journal_record *recs;
+	char ack[12];
+	int segment;
+	int count;
+	int i;
+
+	journal_lock = xSemaphoreCreateMutex();
+	ESP_ERROR_CHECK(journal_lock == NULL);
+
+	if (app_spiffs_load_atomic("journal.ack", ack, sizeof(ack)) > 0)
+		journal_ack = strtoul(ack, NULL, 10);
+	journal_next = journal_ack + 1;
+
+	recs = malloc(JOURNAL_SEGMENT_RECORDS * sizeof(*recs));
+	if (!recs)
+		return;
+
+	for (segment = 0; segment < JOURNAL_SEGMENTS; segment++) {
+		count = app_journal_read(segment, recs, JOURNAL_SEGMENT_RECORDS);
+		for (i = 0; i < count; i++) {
+			if (recs[i].seq >= journal_next)
+				journal_next = recs[i].seq + 1;
+		}
+	}
+	free(recs);
+
+	ESP_LOGI(TAG, "Pending records: %d", app_journal_pending());
+}
@@ -0,0 +1,225 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "mbedtls/md.h"
+#include "app_lan.h"
+
+static const char *TAG = "app-lan";
+
+#define LAN_CMD_SIZE			8
+#define LAN_MAC_SIZE			32
+#define LAN_TIME_WINDOW			30000	/* ms */
+
+/*
+ * Request and reply share the same layout. The MAC is
+ * HMAC-SHA256(key, device id || cmd || time) where key is SHA256 of the
+ * private key PEM text without leading and trailing whitespace. The
+ * device id is not sent, it only binds the packet to one device of a
+ * fleet that shares the key.
+ */
+struct app_lan_packet {
+	char cmd[LAN_CMD_SIZE];
+	uint8_t time[8];		/* Unix time in ms, little endian */
+	uint8_t mac[LAN_MAC_SIZE];
+} __attribute__((packed));
+
+static const char *lan_id;
+static uint8_t lan_key[LAN_MAC_SIZE];
+static bool lan_key_valid = false;
+static SemaphoreHandle_t lan_lock;
+static app_lan_handler lan_handler;
+static volatile bool lan_enable = false;
+static uint64_t lan_last_time = 0;
+
+static int app_lan_mac(const struct app_lan_packet *packet, uint8_t *mac)
+{
+	const mbedtls_md_info_t *info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+	mbedtls_md_context_t ctx;
+	int ret = -1;
+
+	mbedtls_md_init(&ctx);
+	xSemaphoreTake(lan_lock, portMAX_DELAY);
+	if (lan_key_valid) {
+		ret = mbedtls_md_setup(&ctx, info, 1);
+		if (!ret)
+			ret = mbedtls_md_hmac_starts(&ctx, lan_key, sizeof(lan_key));
+	}
+	xSemaphoreGive(lan_lock);
+
+	if (!ret)
+		ret = mbedtls_md_hmac_update(&ctx, (const uint8_t *)lan_id, strlen(lan_id));
+	if (!ret)
+		ret = mbedtls_md_hmac_update(&ctx, (const uint8_t *)packet,
+					     offsetof(struct app_lan_packet, mac));
+	if (!ret)
+		ret = mbedtls_md_hmac_finish(&ctx, mac);
+	mbedtls_md_free(&ctx);
+
+	return ret;
+}
+
+static bool app_lan_verify(const struct app_lan_packet *packet)
+{
+	uint8_t mac[LAN_MAC_SIZE];
+	uint8_t diff = 0;
+	struct timeval tv;
+	uint64_t now;
+	uint64_t boot;
+	uint64_t time = 0;
+	int i;
+
+	if (app_lan_mac(packet, mac))
+		return false;
+
+	/* Constant time compare */
+	for (i = 0; i < LAN_MAC_SIZE; i++)
+		diff |= mac[i] ^ packet->mac[i];
+	if (diff)
+		return false;
+
+	for (i = 7; i >= 0; i--)
+		time = (time << 8) | packet->time[i];
+
+	/*
+	 * Reject replays: must be recent and newer than the last accepted
+	 * one. lan_last_time is lost on reboot, so also require the request
+	 * to be made after this boot, the clock is synchronized by now.
+	 */
+	gettimeofday(&tv, NULL);
+	now = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	boot = now - esp_timer_get_time() / 1000;
+	if (time + LAN_TIME_WINDOW < now || time > now + LAN_TIME_WINDOW ||
+	    time <= lan_last_time || time <= boot)
+		return false;
+
+	lan_last_time = time;
+
+	return true;
+}
+
+static void app_lan_task(void *pvParameters)
+{
+	struct app_lan_packet packet;
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(APP_LAN_PORT),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+	struct sockaddr_storage source;
+	socklen_t socklen;
+	int sock;
+	int len;
+	int state;
+
+	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+	if (sock < 0) {
+		ESP_LOGE(TAG, "Unable to create socket");
+		vTaskDelete(NULL);
+		return;
+	}
+
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TAG, "Socket unable to bind");
+		close(sock);
+		vTaskDelete(NULL);
+		return;
+	}
+
+	ESP_LOGI(TAG, "Listening on UDP port %d", APP_LAN_PORT);
+
+	while (1) {
+		socklen = sizeof(source);
+		len = recvfrom(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&source, &socklen);
+		if (len != sizeof(packet) || !lan_enable)
+			continue;
+
+		if (!app_lan_verify(&packet)) {
+			ESP_LOGW(TAG, "Drop unauthenticated packet");
+			continue;
+		}
+
+		packet.cmd[LAN_CMD_SIZE - 1] = '\0';
+		state = lan_handler(packet.cmd);
+
+		/* Reply with the detected state, signed with the same key */
+		memset(packet.cmd, 0, sizeof(packet.cmd));
+		strcpy(packet.cmd, state < 0 ? "UNKNOWN" : state ? "ON" : "OFF");
+		if (app_lan_mac(&packet, packet.mac))
+			continue;
+		sendto(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&source, socklen);
+	}
+}
+
+void app_lan_enable(bool enable)
+{
+	lan_enable = enable;
+}
+
+bool app_lan_enabled(void)
+{
+	return lan_enable;
+}
+
+/* Derive the key once, again whenever the private key is changed */
+void app_lan_set_key(const char *privkey)
+{
+	const mbedtls_md_info_t *info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+	const char *start = privkey;
+	const char *end = privkey + strlen(privkey);
+
+	while (start < end && isspace((unsigned char)*start))
+		start++;
+	while (end > start && isspace((unsigned char)end[-1]))
+		end--;
+
+	xSemaphoreTake(lan_lock, portMAX_DELAY);
+	lan_key_valid = start != end &&
+			!mbedtls_md(info, (const uint8_t *)start, end - start, lan_key);
+	if (!lan_key_valid)
+		memset(lan_key, 0, sizeof(lan_key));
+	xSemaphoreGive(lan_lock);
+}
+
+void app_lan_init(const char *id, const char *privkey, app_lan_handler handler)
+{
+	lan_id = id;
+	lan_handler = handler;
+	lan_lock = xSemaphoreCreateMutex();
+	ESP_ERROR_CHECK(lan_lock == NULL);
+	app_lan_set_key(privkey);
+
+	xTaskCreate(app_lan_task, "app_lan_task", 1024 * 4, NULL, 6, NULL);
+}
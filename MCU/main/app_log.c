@@ -0,0 +1,197 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "app_log.h"
+
+#define APP_LOG_SIZE			64	/* Must be a power of 2 */
+#define APP_LOG_ARGS			4
+#define APP_LOG_TEXT_SIZE		48
+
+struct app_log_record {
+	volatile uint32_t seq;		/* Index + 1 when complete, 0 while being written */
+	uint32_t time;
+	const char *fmt;
+	bool text;
+	union {
+		uint32_t args[APP_LOG_ARGS];
+		char str[APP_LOG_TEXT_SIZE];
+	};
+};
+
+static struct app_log_record log_ring[APP_LOG_SIZE];
+static uint32_t log_head = 0;		/* Next index to reserve */
+static uint32_t log_tail = 0;		/* Next index to print */
+static uint32_t log_dropped = 0;
+static TaskHandle_t log_task = NULL;
+
+static struct app_log_record *app_log_reserve(uint32_t *index)
+{
+	struct app_log_record *rec;
+	uint32_t head = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+
+	do {
+		/* Never overwrite records that have not been printed yet */
+		if (head - __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE) >= APP_LOG_SIZE) {
+			__atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&log_head, &head, head + 1, false,
+					      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	rec = &log_ring[head & (APP_LOG_SIZE - 1)];
+	rec->seq = 0;
+	rec->time = esp_log_timestamp();
+	*index = head;
+
+	return rec;
+}
+
+static void app_log_commit(struct app_log_record *rec, uint32_t index)
+{
+	__atomic_store_n(&rec->seq, index + 1, __ATOMIC_RELEASE);
+
+	if (log_task)
+		xTaskNotifyGive(log_task);
+}
+
+void app_log_write(const char *fmt, ...)
+{
+	struct app_log_record *rec;
+	uint32_t index;
+	va_list ap;
+	int i;
+
+	rec = app_log_reserve(&index);
+	if (!rec)
+		return;
+
+	rec->fmt = fmt;
+	rec->text = false;
+
+	/* APP_LOG() always pads with four zeros, so this never reads past the arguments */
+	va_start(ap, fmt);
+	for (i = 0; i < APP_LOG_ARGS; i++)
+		rec->args[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+
+	app_log_commit(rec, index);
+}
+
+void app_log_write_text(const char *fmt, const char *text)
+{
+	struct app_log_record *rec;
+	uint32_t index;
+
+	rec = app_log_reserve(&index);
+	if (!rec)
+		return;
+
+	rec->fmt = fmt;
+	rec->text = true;
+	strncpy(rec->str, text, sizeof(rec->str) - 1);
+	rec->str[sizeof(rec->str) - 1] = '\0';
+
+	app_log_commit(rec, index);
+}
+
+uint32_t app_log_dropped(void)
+{
+	return __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+}
+
+static void app_log_print(const struct app_log_record *rec)
+{
+	if (rec->text)
+		printf(rec->fmt, rec->str);
+	else
+		printf(rec->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+}
+
+static void app_log_task(void *pvParameters)
+{
+	struct app_log_record *rec;
+	uint32_t tail;
+	uint32_t dropped;
+	uint32_t reported = 0;
+
+	while (1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		tail = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+		while (tail != __atomic_load_n(&log_head, __ATOMIC_ACQUIRE)) {
+			rec = &log_ring[tail & (APP_LOG_SIZE - 1)];
+			/* Reserved but not yet committed, wait for its notification */
+			if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1)
+				break;
+
+			app_log_print(rec);
+			tail++;
+			__atomic_store_n(&log_tail, tail, __ATOMIC_RELEASE);
+		}
+
+		dropped = app_log_dropped();
+		if (dropped != reported) {
+			printf("Log buffer overflow, %u records dropped\n", dropped - reported);
+			reported = dropped;
+		}
+	}
+}
+
+void app_log_dump(void)
+{
+	struct app_log_record rec;
+	uint32_t head;
+	uint32_t index;
+	int count = 0;
+
+	head = __atomic_load_n(&log_head, __ATOMIC_ACQUIRE);
+	index = head > APP_LOG_SIZE ? head - APP_LOG_SIZE : 0;
+
+	for (; index != head; index++) {
+		memcpy(&rec, &log_ring[index & (APP_LOG_SIZE - 1)], sizeof(rec));
+		/* Skip records that are being written or were overwritten while copying */
+		if (rec.seq != index + 1 || log_ring[index & (APP_LOG_SIZE - 1)].seq != index + 1)
+			continue;
+
+		printf("[%u] ", rec.time);
+		app_log_print(&rec);
+		count++;
+	}
+
+	printf("Records: %d, dropped: %u\n", count, app_log_dropped());
+}
+
+void app_log_init(void)
+{
+	xTaskCreate(app_log_task, "app_log_task", 1024 * 3, NULL, 1, &log_task);
+	ESP_ERROR_CHECK(log_task == NULL);
+}
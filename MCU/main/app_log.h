@@ -0,0 +1,55 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __APP_LOG_H_
+#define __APP_LOG_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Deferred logging for the poll/commit path.
+ *
+ * APP_LOG() only stores the format pointer and up to four 32-bit arguments
+ * (int, unsigned or pointer to a string that outlives the call) in a ring
+ * buffer, the formatting and console output happen later in a low-priority
+ * task. Use APP_LOG_TEXT() when the string argument is a temporary buffer.
+ */
+#define APP_LOG(fmt, ...)		app_log_write(fmt, ##__VA_ARGS__, 0, 0, 0, 0)
+#define APP_LOG_TEXT(fmt, text)		app_log_write_text(fmt, text)
+
+void app_log_init(void);
+void app_log_write(const char *fmt, ...);
+void app_log_write_text(const char *fmt, const char *text);
+uint32_t app_log_dropped(void);
+void app_log_dump(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __APP_LOG_H_ */
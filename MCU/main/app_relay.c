@@ -46,9 +46,19 @@ void app_relay_init(void)
         gpio_set_level(RELAY_IO, 0);
 }
 
+void app_relay_press(void)
+{
+	gpio_set_level(RELAY_IO, 1);
+}
+
+void app_relay_release(void)
+{
+	gpio_set_level(RELAY_IO, 0);
+}
+
 void app_relay_on(int ms)
 {
-        gpio_set_level(RELAY_IO, 1);
+	app_relay_press();
 	vTaskDelay(ms / portTICK_RATE_MS);
-        gpio_set_level(RELAY_IO, 0);
+	app_relay_release();
 }
@@ -30,6 +30,8 @@ extern "C" {
 #endif /* __cplusplus */
 
 void app_relay_init(void);
+void app_relay_press(void);
+void app_relay_release(void);
 void app_relay_on(int ms);
 
 #ifdef __cplusplus
@@ -0,0 +1,348 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "app_adc.h"
+#include "app_spiffs.h"
+#include "app_sched.h"
+
+static const char *TAG = "app-sched";
+
+/*
+ * Scheduled actions, received as remote commands:
+ *   AT <HH:MM> <PRESS|REPORT> [IFOFF]     - Next occurrence of the local time
+ *   AFTER <minutes> <PRESS|REPORT> [IFOFF] - Relative to now
+ *   CANCEL                                 - Drop all pending actions
+ * IFOFF skips the action when DET is already on.
+ *
+ * Pending actions live in a hashed timer wheel with one second ticks.
+ * Insertion is O(1) and each tick only walks one slot. The action table
+ * is saved to SPIFFS on every change so it survives a reboot.
+ */
+#define SCHED_ACTIONS			16
+#define SCHED_SLOTS			64
+#define SCHED_NONE			-1
+#define SCHED_LATE_LIMIT		600	/* s, run actions missed while rebooting, drop older */
+#define SCHED_RETRY			10	/* s, run again when the handler was busy */
+#define SCHED_TIME_VALID		1600000000
+
+#define SCHED_FLAG_IFOFF		BIT0
+
+struct app_sched_action {
+	uint32_t due;
+	char cmd[7];
+	uint8_t flags;
+};
+
+static struct app_sched_action sched_actions[SCHED_ACTIONS];
+static int8_t sched_next[SCHED_ACTIONS];
+static int8_t sched_wheel[SCHED_SLOTS];
+static uint32_t sched_tick = 0;		/* Last processed second */
+static SemaphoreHandle_t sched_lock;
+static app_sched_handler sched_handler;
+
+static void app_sched_save(void)
+{
+	app_spiffs_save_atomic("schedule", (char *)sched_actions, sizeof(sched_actions));
+}
+
+/* Caller holds sched_lock, the action is expired on the first turn at or after tick */
+static void app_sched_link(int index, uint32_t tick)
+{
+	int slot = tick % SCHED_SLOTS;
+
+	sched_next[index] = sched_wheel[slot];
+	sched_wheel[slot] = index;
+}
+
+/* Caller holds sched_lock */
+static void app_sched_reset(void)
+{
+	memset(sched_next, SCHED_NONE, sizeof(sched_next));
+	memset(sched_wheel, SCHED_NONE, sizeof(sched_wheel));
+}
+
+static int app_sched_add(uint32_t due, const char *cmd, uint8_t flags)
+{
+	int index;
+
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	/* The same command delivered again, e.g. after a reconnect */
+	for (index = 0; index < SCHED_ACTIONS; index++) {
+		if (sched_actions[index].due == due && sched_actions[index].flags == flags &&
+		    !strcmp(sched_actions[index].cmd, cmd)) {
+			xSemaphoreGive(sched_lock);
+			return 0;
+		}
+	}
+
+	for (index = 0; index < SCHED_ACTIONS; index++) {
+		if (!sched_actions[index].due)
+			break;
+	}
+	if (index == SCHED_ACTIONS) {
+		xSemaphoreGive(sched_lock);
+		ESP_LOGE(TAG, "Schedule is full");
+		return -1;
+	}
+
+	sched_actions[index].due = due;
+	strcpy(sched_actions[index].cmd, cmd);
+	sched_actions[index].flags = flags;
+	app_sched_link(index, due);
+	app_sched_save();
+	xSemaphoreGive(sched_lock);
+
+	return 0;
+}
+
+bool app_sched_command(const char *data)
+{
+	char type[8] = "";
+	char arg[8] = "";
+	char cmd[8] = "";
+	char cond[8] = "";
+	time_t now = time(NULL);
+	struct tm tm;
+	uint32_t due;
+	int hour;
+	int min;
+	long minutes;
+	char *end;
+
+	if (sscanf(data, "%7s", type) < 1)
+		return false;
+
+	if (!strcmp(type, "CANCEL")) {
+		xSemaphoreTake(sched_lock, portMAX_DELAY);
+		memset(sched_actions, 0, sizeof(sched_actions));
+		app_sched_reset();
+		app_sched_save();
+		xSemaphoreGive(sched_lock);
+		ESP_LOGI(TAG, "All actions cancelled");
+		return true;
+	}
+
+	if (strcmp(type, "AT") && strcmp(type, "AFTER"))
+		return false;
+
+	if (sscanf(data, "%*s %7s %7s %7s", arg, cmd, cond) < 2 ||
+	    (strcmp(cmd, "PRESS") && strcmp(cmd, "REPORT"))) {
+		ESP_LOGW(TAG, "Invalid schedule: %s", data);
+		return true;
+	}
+
+	if (now < SCHED_TIME_VALID) {
+		ESP_LOGW(TAG, "Time is not synchronized");
+		return true;
+	}
+
+	if (!strcmp(type, "AT")) {
+		if (sscanf(arg, "%d:%d", &hour, &min) != 2 || hour < 0 || hour > 23 || min < 0 || min > 59) {
+			ESP_LOGW(TAG, "Invalid time: %s", arg);
+			return true;
+		}
+		localtime_r(&now, &tm);
+		tm.tm_hour = hour;
+		tm.tm_min = min;
+		tm.tm_sec = 0;
+		due = mktime(&tm);
+		if (due <= now)
+			due += 24 * 3600;
+	} else {
+		minutes = strtol(arg, &end, 10);
+		if (*end || minutes <= 0) {
+			ESP_LOGW(TAG, "Invalid schedule: %s", data);
+			return true;
+		}
+		due = now + minutes * 60;
+	}
+
+	if (!app_sched_add(due, cmd, strcmp(cond, "IFOFF") ? 0 : SCHED_FLAG_IFOFF))
+		ESP_LOGI(TAG, "%s scheduled in %u seconds", cmd, due - (uint32_t)now);
+
+	return true;
+}
+
+/* Return false if the handler could not run the command, e.g. a press is in progress */
+static bool app_sched_run(struct app_sched_action *action)
+{
+	if ((action->flags & SCHED_FLAG_IFOFF) && app_adc_detect()) {
+		ESP_LOGI(TAG, "Skip %s, already on", action->cmd);
+		return true;
+	}
+
+	ESP_LOGI(TAG, "Run %s", action->cmd);
+	return sched_handler(action->cmd) >= 0;
+}
+
+/*
+ * Put a failed action back for another try. The due time is kept, so
+ * it is dropped once it is later than SCHED_LATE_LIMIT.
+ */
+static void app_sched_retry(struct app_sched_action *action, uint32_t tick)
+{
+	int index;
+
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	for (index = 0; index < SCHED_ACTIONS; index++) {
+		if (!sched_actions[index].due)
+			break;
+	}
+	if (index == SCHED_ACTIONS) {
+		xSemaphoreGive(sched_lock);
+		ESP_LOGE(TAG, "Schedule is full, %s is lost", action->cmd);
+		return;
+	}
+
+	sched_actions[index] = *action;
+	app_sched_link(index, tick + SCHED_RETRY);
+	app_sched_save();
+	xSemaphoreGive(sched_lock);
+
+	ESP_LOGW(TAG, "%s failed, retry in %d seconds", action->cmd, SCHED_RETRY);
+}
+
+/* Process one wheel slot, run and free the actions that are due */
+static void app_sched_expire(uint32_t tick)
+{
+	struct app_sched_action run[SCHED_ACTIONS];
+	int8_t *link;
+	int index;
+	int count = 0;
+	bool changed = false;
+	int i;
+
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	link = &sched_wheel[tick % SCHED_SLOTS];
+	while (*link != SCHED_NONE) {
+		index = *link;
+		/* Entries due in a later round of the wheel stay in the slot */
+		if (sched_actions[index].due > tick) {
+			link = &sched_next[index];
+			continue;
+		}
+		*link = sched_next[index];
+		/*
+		 * Saved actions are linked before time is synchronized, so
+		 * staleness can only be judged here, against the real clock
+		 */
+		if (sched_actions[index].due + SCHED_LATE_LIMIT < tick)
+			ESP_LOGE(TAG, "Drop expired %s", sched_actions[index].cmd);
+		else
+			run[count++] = sched_actions[index];
+		memset(&sched_actions[index], 0, sizeof(sched_actions[index]));
+		changed = true;
+	}
+	if (changed)
+		app_sched_save();
+	xSemaphoreGive(sched_lock);
+
+	/* Run without the lock, a press takes seconds */
+	for (i = 0; i < count; i++) {
+		if (!app_sched_run(&run[i]))
+			app_sched_retry(&run[i], tick);
+	}
+}
+
+/* Advance the wheel up to now */
+static void app_sched_step(uint32_t now)
+{
+	int steps;
+
+	if (now < SCHED_TIME_VALID)
+		return;
+
+	/* Catch up on missed ticks, one full turn covers every slot */
+	if (!sched_tick || now - sched_tick > SCHED_SLOTS)
+		sched_tick = now - SCHED_SLOTS;
+	for (steps = 0; sched_tick < now && steps < SCHED_SLOTS; steps++)
+		app_sched_expire(++sched_tick);
+}
+
+static void app_sched_task(void *pvParameters)
+{
+	while (1) {
+		vTaskDelay(1000 / portTICK_PERIOD_MS);
+		app_sched_step(time(NULL));
+	}
+}
+
+void app_sched_show(void)
+{
+	uint32_t now = time(NULL);
+	time_t due;
+	struct tm tm;
+	int count = 0;
+	int i;
+
+	xSemaphoreTake(sched_lock, portMAX_DELAY);
+	for (i = 0; i < SCHED_ACTIONS; i++) {
+		if (!sched_actions[i].due)
+			continue;
+		due = sched_actions[i].due;
+		localtime_r(&due, &tm);
+		printf("%02d:%02d:%02d  %-6s %-5s  in %d seconds\n", tm.tm_hour, tm.tm_min, tm.tm_sec,
+		       sched_actions[i].cmd, sched_actions[i].flags & SCHED_FLAG_IFOFF ? "IFOFF" : "",
+		       (int)(sched_actions[i].due - now));
+		count++;
+	}
+	xSemaphoreGive(sched_lock);
+
+	printf("Scheduled actions: %d\n", count);
+}
+
+void app_sched_init(app_sched_handler handler)
+{
+	/* Room for '\0' and one more byte, so that a longer file is noticed */
+	static char buf[sizeof(sched_actions) + 2];
+	int i;
+
+	sched_handler = handler;
+	sched_lock = xSemaphoreCreateMutex();
+	ESP_ERROR_CHECK(sched_lock == NULL);
+
+	app_sched_reset();
+	/* A file of any other length is not ours, or was torn */
+	if (app_spiffs_load_atomic("schedule", buf, sizeof(buf)) == sizeof(sched_actions))
+		memcpy(sched_actions, buf, sizeof(sched_actions));
+
+	for (i = 0; i < SCHED_ACTIONS; i++) {
+		if (!sched_actions[i].due)
+			continue;
+		/* Time may not be synchronized yet, expired ones are dropped by the wheel */
+		sched_actions[i].cmd[sizeof(sched_actions[i].cmd) - 1] = '\0';
+		app_sched_link(i, sched_actions[i].due);
+	}
+
+	xTaskCreate(app_sched_task, "app_sched_task", 1024 * 3, NULL, 4, NULL);
+}
@@ -97,7 +97,7 @@ int app_spiffs_save(char *name, char *data, int size)
 	int ret;
 
 	sprintf(path, "/spiffs/%s", name);
-	ESP_LOGI(TAG, "Open: %s", path);
+	ESP_LOGD(TAG, "Open: %s", path);
 
 	f = fopen(path, "wb");
 	if (f == NULL) {
@@ -106,28 +106,29 @@ int app_spiffs_save(char *name, char *data, int size)
 	}
 
 	ret = fwrite(data, 1, size, f);
-	if (ret != size)
+	if (fclose(f) || ret != size) {
 		ESP_LOGE(TAG, "File write failed, ret:%d", ret);
-	else
-		ESP_LOGI(TAG, "File written");
+		return -1;
+	}
 
-	fclose(f);
+	ESP_LOGD(TAG, "File written");
 
 	return 0;
 }
 
-int app_spiffs_load(char *name, char *buff, int size)
+/* Return the number of bytes read */
+static int app_spiffs_read(char *name, char *buff, int size)
 {
 	char path[32];
 	FILE* f;
 	int ret;
 
 	sprintf(path, "/spiffs/%s", name);
-	ESP_LOGI(TAG, "Open %s", path);
+	ESP_LOGD(TAG, "Open %s", path);
 
 	f = fopen(path, "rb");
 	if (f == NULL) {
-		ESP_LOGI(TAG, "Failed to open file for reading");
+		ESP_LOGD(TAG, "Failed to open file for reading");
 		return -1;
 	}
 
@@ -139,10 +140,58 @@ int app_spiffs_load(char *name, char *buff, int size)
 		ESP_LOGE(TAG, "Reading error or file is empty");
 		return -1;
 	} else {
-		ESP_LOGI(TAG, "File read size: %d bytes", ret);
+		ESP_LOGD(TAG, "File read size: %d bytes", ret);
 	}
 
 	buff[ret] = '\0';
 
+	return ret;
+}
+
+int app_spiffs_load(char *name, char *buff, int size)
+{
+	return app_spiffs_read(name, buff, size) < 0 ? -1 : 0;
+}
+
+/*
+ * Write to "<name>.tmp" first and rename it over the old file, a power
+ * loss then leaves either the old or the new content, never a torn file.
+ */
+int app_spiffs_save_atomic(char *name, char *data, int size)
+{
+	char tmp[32];
+	char from[40];
+	char to[32];
+	int ret;
+
+	sprintf(tmp, "%s.tmp", name);
+	ret = app_spiffs_save(tmp, data, size);
+	if (ret)
+		return ret;
+
+	sprintf(from, "/spiffs/%s", tmp);
+	sprintf(to, "/spiffs/%s", name);
+	/* SPIFFS does not rename over an existing file */
+	unlink(to);
+	if (rename(from, to)) {
+		ESP_LOGE(TAG, "Failed to rename %s", from);
+		return -1;
+	}
+
 	return 0;
 }
+
+/* Return the number of bytes read, so that callers can reject a short file */
+int app_spiffs_load_atomic(char *name, char *buff, int size)
+{
+	char tmp[32];
+	int ret;
+
+	ret = app_spiffs_read(name, buff, size);
+	if (ret >= 0)
+		return ret;
+
+	/* Power lost between unlink and rename, the new content is complete */
+	sprintf(tmp, "%s.tmp", name);
+	return app_spiffs_read(tmp, buff, size);
+}
@@ -36,6 +36,8 @@ extern "C" {
 void app_spiffs_init(void);
 int app_spiffs_save(char *name, char *data, int size);
 int app_spiffs_load(char *name, char *buff, int size);
+int app_spiffs_save_atomic(char *name, char *data, int size);
+int app_spiffs_load_atomic(char *name, char *buff, int size);
 
 #ifdef __cplusplus
 }
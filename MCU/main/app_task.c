@@ -0,0 +1,193 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "app-task";
+
+#define APP_TASK_TOP_MIN		1	/* s */
+#define APP_TASK_TOP_MAX		60	/* s, the console is blocked meanwhile */
+
+/*
+ * Lowest stack high water mark seen right after an SSH KEX, in bytes.
+ * The mark covers the whole life of the task, not only the KEX.
+ */
+static uint32_t kex_stack_free = UINT32_MAX;
+static const char *kex_stack_task = "-";
+
+static const char *app_task_state_name(eTaskState state)
+{
+	switch (state) {
+	case eRunning:
+		return "X";
+	case eReady:
+		return "R";
+	case eBlocked:
+		return "B";
+	case eSuspended:
+		return "S";
+	case eDeleted:
+		return "D";
+	default:
+		return "?";
+	}
+}
+
+/*
+ * Take a snapshot of all tasks into a heap buffer instead of
+ * formatting vTaskList() into a large array on the caller's stack.
+ */
+static TaskStatus_t *app_task_snapshot(UBaseType_t *count, uint32_t *total)
+{
+	TaskStatus_t *status;
+	UBaseType_t size;
+
+	/* Leave room for tasks created between the two calls */
+	size = uxTaskGetNumberOfTasks() + 2;
+	status = malloc(size * sizeof(TaskStatus_t));
+	if (!status) {
+		ESP_LOGE(TAG, "No memory for task snapshot");
+		return NULL;
+	}
+
+	*count = uxTaskGetSystemState(status, size, total);
+
+	return status;
+}
+
+static TaskStatus_t *app_task_find(TaskStatus_t *status, UBaseType_t count, UBaseType_t number)
+{
+	UBaseType_t i;
+
+	for (i = 0; i < count; i++) {
+		if (status[i].xTaskNumber == number)
+			return &status[i];
+	}
+
+	return NULL;
+}
+
+void app_task_show(void)
+{
+	TaskStatus_t *status;
+	UBaseType_t count;
+	UBaseType_t i;
+	uint32_t total;
+
+	status = app_task_snapshot(&count, &total);
+	if (!status)
+		return;
+
+	printf("NAME\t\tSTATE\tPRIO\tHIGH\tNUMBER\n");
+	printf("----\t\t-----\t----\t----\t------\n");
+	for (i = 0; i < count; i++) {
+		printf("%-16s%s\t%u\t%u\t%u\n", status[i].pcTaskName,
+		       app_task_state_name(status[i].eCurrentState),
+		       status[i].uxCurrentPriority,
+		       status[i].usStackHighWaterMark,
+		       status[i].xTaskNumber);
+	}
+
+	free(status);
+}
+
+void app_task_top(int seconds)
+{
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+	TaskStatus_t *start;
+	TaskStatus_t *end;
+	TaskStatus_t *prev;
+	UBaseType_t start_count;
+	UBaseType_t end_count;
+	UBaseType_t i;
+	uint32_t start_total;
+	uint32_t end_total;
+	uint32_t elapsed;
+	uint32_t runtime;
+
+	if (seconds < APP_TASK_TOP_MIN)
+		seconds = APP_TASK_TOP_MIN;
+	else if (seconds > APP_TASK_TOP_MAX)
+		seconds = APP_TASK_TOP_MAX;
+
+	start = app_task_snapshot(&start_count, &start_total);
+	if (!start)
+		return;
+
+	vTaskDelay(seconds * 1000 / portTICK_PERIOD_MS);
+
+	end = app_task_snapshot(&end_count, &end_total);
+	if (!end) {
+		free(start);
+		return;
+	}
+
+	elapsed = end_total - start_total;
+	if (!elapsed)
+		elapsed = 1;
+
+	printf("Interval: %d second\n", seconds);
+	printf("NAME\t\tCPU%%\tPRIO\tMINFREE\n");
+	printf("----\t\t----\t----\t-------\n");
+	for (i = 0; i < end_count; i++) {
+		prev = app_task_find(start, start_count, end[i].xTaskNumber);
+		/* Tasks created during the interval count from zero */
+		runtime = end[i].ulRunTimeCounter - (prev ? prev->ulRunTimeCounter : 0);
+		printf("%-16s%3u.%u\t%u\t%u\n", end[i].pcTaskName,
+		       (uint32_t)((uint64_t)runtime * 100 / elapsed),
+		       (uint32_t)((uint64_t)runtime * 1000 / elapsed % 10),
+		       end[i].uxCurrentPriority,
+		       end[i].usStackHighWaterMark);
+	}
+
+	free(start);
+	free(end);
+#else
+	printf("CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS is not enabled\n");
+#endif
+
+	if (kex_stack_free != UINT32_MAX)
+		printf("%s minimum stack free since boot: %u bytes, checked after each SSH KEX\n",
+		       kex_stack_task, kex_stack_free);
+}
+
+/*
+ * Called right after the SSH connection is set up. The high water mark
+ * of the calling task then includes the deepest point of the key
+ * exchange, as well as anything else the task has run since boot.
+ */
+void app_task_record_kex_stack(void)
+{
+	uint32_t free_size = uxTaskGetStackHighWaterMark(NULL);
+
+	if (free_size < kex_stack_free) {
+		kex_stack_free = free_size;
+		kex_stack_task = pcTaskGetName(NULL);
+	}
+}
@@ -48,6 +48,8 @@ static volatile int retry_count = -1;
 
 static volatile bool app_wifi_state = false;
 
+static void (*app_wifi_callback)(bool available);
+
 bool app_wifi_available(void)
 {
 	return app_wifi_state;
@@ -70,22 +72,31 @@ static void event_handler(void* arg, esp_event_base_t event_base,
 			retry_count = -1;
 			ESP_LOGI(TAG,"Connect to the AP fail");
 		}
-		app_wifi_state = false;
+		/* Retries disconnect again, only report the transition */
+		if (app_wifi_state) {
+			app_wifi_state = false;
+			if (app_wifi_callback)
+				app_wifi_callback(false);
+		}
 	} else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
 		ESP_LOGI(TAG, "Got ip:" IPSTR, IP2STR(&event->ip_info.ip));
 		retry_count = -1;
 		xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
 		app_wifi_state = true;
+		if (app_wifi_callback)
+			app_wifi_callback(true);
 	}
 }
 
-void app_wifi_init(void)
+void app_wifi_init(void (*callback)(bool available))
 {
 	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
 	esp_event_handler_instance_t instance_any_id;
 	esp_event_handler_instance_t instance_got_ip;
 
+	app_wifi_callback = callback;
+
 	ESP_ERROR_CHECK(esp_netif_init());
 	ESP_ERROR_CHECK(esp_event_loop_create_default());
 	esp_netif_create_default_wifi_sta();
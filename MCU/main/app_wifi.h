@@ -33,7 +33,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
-void app_wifi_init(void);
+void app_wifi_init(void (*callback)(bool available));
 int app_wifi_connect(const char *ssid, const char *password);
 bool app_wifi_available(void);
 
@@ -37,6 +37,7 @@
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "driver/usb_serial_jtag.h"
 #include "sdkconfig.h"
 #include "esp_check.h"
@@ -50,6 +51,12 @@
 #include "app_led.h"
 #include "app_relay.h"
 #include "app_adc.h"
+#include "app_log.h"
+#include "app_task.h"
+#include "app_lan.h"
+#include "app_journal.h"
+#include "app_history.h"
+#include "app_sched.h"
 
 #define COMMAND_PREFIX			"GITT"
 #define TAG				"app-main"
@@ -79,37 +86,408 @@ static volatile uint8_t app_state = APP_STATE_SERVER_STOP;
 
 static EventGroupHandle_t app_event_group;
 
+/* Notification bits of app_main_task, a timeout means the next poll is due */
+#define APP_NOTIFY_WIFI			BIT0	/* Wifi connected or disconnected */
+#define APP_NOTIFY_CONFIG		BIT1	/* Repository or private key changed */
+#define APP_NOTIFY_STATE		BIT2	/* Server start or stop requested */
+#define APP_NOTIFY_COMMAND		BIT3	/* Local command executed, report it now */
+
+static TaskHandle_t app_main_handle;
+
 #define APP_RESPONSE_NONE		0
 #define APP_RESPONSE_REPORT		1
 #define APP_RESPONSE_PRESS		2
 
 static volatile int app_response = APP_RESPONSE_NONE;
 
+#define APP_REPORT_NONE			-1
+
+static SemaphoreHandle_t app_exec_lock;
+
+/* Press started by a local command, its DET transition is timed by app_main_task */
+static struct {
+	volatile bool pending;
+	bool before;
+	uint32_t start;
+	int latency;
+} app_local_press;
+
+#define APP_LOCAL_REPORTS		8
+
+/* States read by local REPORT commands, journaled by app_main_task */
+static struct {
+	int count;
+	bool state[APP_LOCAL_REPORTS];
+} app_local_report;
+
 #define APP_WDT_TIMEOUT			60
+#define APP_WDT_WARN			5
+
+static TaskHandle_t app_wdt_handle;
+
+#define APP_PRESS_HOLD			2000	/* ms */
+#define APP_PRESS_TIMEOUT		30000	/* ms, must stay well below APP_WDT_TIMEOUT */
+
+/* Press to DET transition latency statistics */
+static struct {
+	uint32_t count;
+	uint32_t timeout;
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;
+} app_press_stat;
+
+/* Boot to first poll time and poll cycle time statistics */
+static struct {
+	uint32_t boot;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;
+} app_poll_stat;
+
+#define APP_COMMIT_RETRY		3
+#define APP_COMMIT_BACKOFF_MIN		500	/* ms */
+#define APP_COMMIT_BACKOFF_RANGE	2000	/* ms */
+
+static void app_main_notify(uint32_t bits)
+{
+	if (app_main_handle)
+		xTaskNotify(app_main_handle, bits, eSetBits);
+}
+
+/*
+ * Any progress of the server feeds the application watchdog, only ever
+ * called from app_main_task so that other tasks cannot hide a hang
+ */
+static void app_wdt_feed(void)
+{
+	if (app_wdt_handle)
+		xTaskNotifyGive(app_wdt_handle);
+}
+
+/*
+ * Sleep until notified or until ticks have passed, whichever comes
+ * first. Returns the notification bits, 0 on timeout.
+ */
+static uint32_t app_main_wait(TickType_t ticks)
+{
+	uint32_t bits = 0;
+
+	xTaskNotifyWait(0, UINT32_MAX, &bits, ticks);
+	app_wdt_feed();
+
+	/* The console has written a new private key */
+	if (bits & APP_NOTIFY_CONFIG)
+		app_lan_set_key(app.privkey);
+
+	return bits;
+}
+
+static void app_wifi_callback(bool available)
+{
+	app_main_notify(APP_NOTIFY_WIFI);
+}
+
+static int app_parse_command(const char *data)
+{
+	if (!memcmp("REPORT", data, 5))
+		return APP_RESPONSE_REPORT;
+	else if (!memcmp("PRESS", data, 5))
+		return APP_RESPONSE_PRESS;
+
+	return APP_RESPONSE_NONE;
+}
+
+/*
+ * Hold the button for the full press time while sampling DET. Return the
+ * latency in ms from the start of the press, or -1 if DET has not
+ * changed yet.
+ */
+static int app_press_hold(bool before, uint32_t start)
+{
+	uint32_t elapsed;
+	int latency = -1;
+
+	app_relay_press();
+	if (app_adc_wait_detect(!before, APP_PRESS_HOLD))
+		latency = esp_log_timestamp() - start;
+
+	elapsed = esp_log_timestamp() - start;
+	if (elapsed < APP_PRESS_HOLD)
+		vTaskDelay((APP_PRESS_HOLD - elapsed) / portTICK_PERIOD_MS);
+	app_relay_release();
+
+	return latency;
+}
+
+/*
+ * Sample DET after the hold until it changes or the timeout expires,
+ * instead of reading it once after the press. The host may need several
+ * seconds to raise or drop DET. Return the latency, or -1 on timeout.
+ */
+static int app_press_finish(bool before, uint32_t start, int latency)
+{
+	uint32_t elapsed = esp_log_timestamp() - start;
+
+	if (latency < 0 && elapsed < APP_PRESS_TIMEOUT &&
+	    app_adc_wait_detect(!before, APP_PRESS_TIMEOUT - elapsed))
+		latency = esp_log_timestamp() - start;
+
+	if (latency < 0) {
+		app_press_stat.timeout++;
+	} else {
+		if (!app_press_stat.count || latency < app_press_stat.min)
+			app_press_stat.min = latency;
+		if (latency > app_press_stat.max)
+			app_press_stat.max = latency;
+		app_press_stat.total += latency;
+		app_press_stat.count++;
+	}
+
+	return latency;
+}
+
+/*
+ * The relay is only held under app_exec_lock, the DET wait after it
+ * does not keep local commands waiting
+ */
+static int app_press(void)
+{
+	bool before;
+	uint32_t start;
+	int latency;
+
+	xSemaphoreTake(app_exec_lock, portMAX_DELAY);
+	before = app_adc_detect();
+	start = esp_log_timestamp();
+	latency = app_press_hold(before, start);
+	xSemaphoreGive(app_exec_lock);
+
+	return app_press_finish(before, start, latency);
+}
+
+/*
+ * Command executor of the git poll loop, which may wait for DET up to
+ * APP_PRESS_TIMEOUT. latency is set to the press to DET latency, or -1
+ * if not measured.
+ */
+static bool app_execute(int response, int *latency)
+{
+	bool state;
+
+	*latency = -1;
+	if (response == APP_RESPONSE_PRESS)
+		*latency = app_press();
+	state = app_adc_detect();
+
+	APP_LOG("Detect state: %s\n", state ? "ON" : "OFF");
+	if (response == APP_RESPONSE_PRESS)
+		APP_LOG("Press to DET latency: %d ms\n", *latency);
+
+	return state;
+}
+
+/*
+ * Time the DET transition of a locally started press in app_main_task,
+ * so that the LAN and schedule tasks return right after the hold.
+ * Return the detected state, or APP_REPORT_NONE if no press is pending.
+ */
+static int app_local_press_finish(int *latency)
+{
+	bool state;
+
+	*latency = -1;
+	if (!app_local_press.pending)
+		return APP_REPORT_NONE;
+
+	/* No lock, a new local press is refused until pending is cleared */
+	*latency = app_press_finish(app_local_press.before, app_local_press.start,
+				    app_local_press.latency);
+	state = app_adc_detect();
+	app_local_press.pending = false;
+
+	APP_LOG("Detect state: %s\n", state ? "ON" : "OFF");
+	APP_LOG("Press to DET latency: %d ms\n", *latency);
+
+	return state;
+}
+
+/*
+ * Journal the reports of local commands here rather than in the LAN
+ * task, which replies first. The next successful poll pushes them.
+ */
+static void app_local_report_journal(void)
+{
+	bool state[APP_LOCAL_REPORTS];
+	int count;
+	int i;
+
+	xSemaphoreTake(app_exec_lock, portMAX_DELAY);
+	count = app_local_report.count;
+	memcpy(state, app_local_report.state, sizeof(state));
+	app_local_report.count = 0;
+	xSemaphoreGive(app_exec_lock);
+
+	for (i = 0; i < count; i++)
+		app_journal_append(state[i] ? "STATE ON" : "STATE OFF");
+}
+
+/* Not connected to the repository, keep the result for a later push */
+static void app_local_press_journal(void)
+{
+	int latency;
+	int report;
+
+	app_local_report_journal();
+	report = app_local_press_finish(&latency);
+
+	if (report != APP_REPORT_NONE)
+		app_journal_append(report ? "STATE ON" : "STATE OFF");
+}
+
+static bool app_gitt_recv_callback(char *data)
+{
+	int response = app_parse_command(data);
+
+	APP_LOG_TEXT("\nRemote say: %s\n", data);
+	if (app_sched_command(data))
+		return true;
+
+	if (response == APP_RESPONSE_REPORT) {
+		app_response = response;
+		APP_LOG("Set response to report\n");
+	} else if (response == APP_RESPONSE_PRESS) {
+		app_response = response;
+		APP_LOG("Set response to press\n");
+	}
+
+	return response != APP_RESPONSE_NONE;
+}
+
+static int app_local_command(const char *cmd)
+{
+	int response = app_parse_command(cmd);
+	bool state;
+
+	if (response == APP_RESPONSE_NONE)
+		return -1;
+
+	APP_LOG_TEXT("\nLocal command: %s\n", cmd);
+	/* At most one hold of a remote press is in the way, the DET wait is not locked */
+	if (!xSemaphoreTake(app_exec_lock, APP_PRESS_HOLD / portTICK_PERIOD_MS))
+		return -1;
+
+	if (response == APP_RESPONSE_PRESS) {
+		if (app_local_press.pending) {
+			xSemaphoreGive(app_exec_lock);
+			return -1;
+		}
+		app_local_press.before = app_adc_detect();
+		app_local_press.start = esp_log_timestamp();
+		app_local_press.latency = app_press_hold(app_local_press.before,
+							 app_local_press.start);
+		app_local_press.pending = true;
+	}
+	state = app_adc_detect();
+
+	/*
+	 * A report is queued for app_main_task, which journals it so that
+	 * none is lost while offline. A press is reported by app_main_task
+	 * after it has seen the DET transition.
+	 */
+	if (response == APP_RESPONSE_REPORT) {
+		if (app_local_report.count < APP_LOCAL_REPORTS)
+			app_local_report.state[app_local_report.count++] = state;
+		else
+			APP_LOG("Local report dropped, queue full\n");
+	}
+	xSemaphoreGive(app_exec_lock);
+	app_main_notify(APP_NOTIFY_COMMAND);
 
-static volatile int app_wdt_count = 0;
+	return state;
+}
 
-static void app_gitt_recv_callback(char *data)
+/*
+ * All devices of a fleet push to the same branch, so a push is rejected
+ * whenever another device got there first. Back off for a random time,
+ * fetch the new head and try again instead of losing the state report.
+ * Any other failure is returned at once.
+ */
+static int app_commit_event(char *event)
 {
-	printf("\nRemote say: %s\n", data);
-	if (!memcmp("REPORT", data, 5)) {
-		app_response = APP_RESPONSE_REPORT;
-		printf("Set response to report\n");
-	} else if (!memcmp("PRESS", data, 5)) {
-		app_response = APP_RESPONSE_PRESS;
-		printf("Set response to press\n");
+	char head[96];
+	int ret;
+	int err;
+	int retry = 0;
+
+	while (1) {
+		snprintf(head, sizeof(head), "%s", app.g.repository.head);
+		ret = gitt_commit_event(&app.g, event);
+		app_wdt_feed();
+		APP_LOG("Commit event result: %s\n", GITT_ERRNO_STR(ret));
+		if (!ret || retry++ >= APP_COMMIT_RETRY)
+			break;
+
+		/*
+		 * A rejected push means the branch has moved. If a fetch shows
+		 * the same head, the failure is not a race, e.g. the message
+		 * does not fit the buffer, and retrying cannot help.
+		 */
+		err = app_gitt_update(&app);
+		app_wdt_feed();
+		if (err || !strncmp(head, app.g.repository.head, sizeof(head) - 1))
+			break;
+
+		vTaskDelay((APP_COMMIT_BACKOFF_MIN + esp_random() % APP_COMMIT_BACKOFF_RANGE) /
+			   portTICK_PERIOD_MS);
+		app_wdt_feed();
+
+		/* Other devices may have pushed while backing off */
+		err = app_gitt_update(&app);
+		app_wdt_feed();
+		if (err)
+			break;
 	}
+
+	return ret;
+}
+
+static void app_poll_record(uint32_t start)
+{
+	uint32_t cycle = esp_log_timestamp() - start;
+
+	if (!app_poll_stat.boot)
+		app_poll_stat.boot = start + cycle;
+	if (!app_poll_stat.count || cycle < app_poll_stat.min)
+		app_poll_stat.min = cycle;
+	if (cycle > app_poll_stat.max)
+		app_poll_stat.max = cycle;
+	app_poll_stat.total += cycle;
+	app_poll_stat.count++;
 }
 
 static void app_main_task(void *pvParameters)
 {
 	int ret;
-	int count;
+	int response;
+	int report;
+	int latency;
+	char summary[64];
+	uint32_t notify;
+	uint32_t start;
+	TickType_t next;
+	TickType_t delay;
+
+	/* Notifications sent before this point are covered by the checks below */
+	app_main_handle = xTaskGetCurrentTaskHandle();
 
 	/* Wait wifi available */
 	printf("Wait wifi available...\n");
-	while (!app_wifi_available())
-		vTaskDelay(1000 / portTICK_PERIOD_MS);
+	while (!app_wifi_available()) {
+		app_main_wait(portMAX_DELAY);
+		app_local_press_journal();
+	}
 	printf("Wifi available\n");
 
 	/* Update time from net */
@@ -117,88 +495,124 @@ static void app_main_task(void *pvParameters)
 
 	/* Wait repository vaild */
 	printf("Wait repository vaild...\n");
-	while (!strlen(app.repository) || !strlen(app.privkey))
-		vTaskDelay(1000 / portTICK_PERIOD_MS);
+	while (!strlen(app.repository) || !strlen(app.privkey)) {
+		app_main_wait(portMAX_DELAY);
+		app_local_press_journal();
+	}
 	printf("Repository vaild\n");
 
 	/* Auto start */
 	app_state = APP_STATE_SERVER_START;
+	app_wdt_feed();
 
 	while (1) {
 		switch (app_state) {
 		case APP_STATE_SERVER_START:
-			printf("Server started, interval time: %d second\n", app.interval);
+			APP_LOG("Server started, interval time: %d second\n", app.interval);
 			xEventGroupSetBits(app_event_group, APP_EVENT_SERVER_STARTED);
 
 			while (app_state == APP_STATE_SERVER_START) {
 				/* Initialize */
 				ret = app_gitt_init(&app, app_gitt_recv_callback);
 				if (ret) {
-					app_wdt_count = 0;
-					vTaskDelay(1000 / portTICK_PERIOD_MS);
+					/* Retry after a second, or as soon as wifi is back */
+					app_local_press_journal();
+					app_main_wait((app_wifi_available() ? 1000 : APP_WDT_TIMEOUT / 2 * 1000) /
+						      portTICK_PERIOD_MS);
 					continue;
 				}
 
 				app_led_green_on();
-				count = 0;
+				next = xTaskGetTickCount();
 				/* Loop */
 				while (app_state == APP_STATE_SERVER_START) {
-					if (!count) {
-						/* Try update */
-						ret = gitt_update_event(&app.g);
-						// printf("Update event result: %s\n", GITT_ERRNO_STR(ret));
-						if (ret)
+					/* Sleep until the poll is due, a local command cuts it short */
+					delay = next - xTaskGetTickCount();
+					if ((int32_t)delay > 0) {
+						notify = app_main_wait(delay);
+						/* Lost the network, reconnect once it is back */
+						if ((notify & APP_NOTIFY_WIFI) && !app_wifi_available())
 							break;
+						if (!(notify & APP_NOTIFY_COMMAND))
+							continue;
+					}
+					next = xTaskGetTickCount() + app.interval * 1000 / portTICK_PERIOD_MS;
+					start = esp_log_timestamp();
+
+					/* A local press is timed right away, before the slow fetch */
+					app_local_report_journal();
+					report = app_local_press_finish(&latency);
+					app_wdt_feed();
+
+					/* Try update */
+					ret = app_gitt_update(&app);
+					// printf("Update event result: %s\n", GITT_ERRNO_STR(ret));
+					if (ret) {
+						if (report != APP_REPORT_NONE)
+							app_journal_append(report ? "STATE ON" : "STATE OFF");
+						break;
+					}
+
+					/*
+					 * Response, take the request first so that
+					 * commands fetched while retrying are kept
+					 */
+					response = app_response;
+					app_response = APP_RESPONSE_NONE;
+					if (response == APP_RESPONSE_REPORT ||
+					    response == APP_RESPONSE_PRESS) {
+						/* The remote command wins, keep the local press result */
+						if (report != APP_REPORT_NONE)
+							app_journal_append(report ? "STATE ON" : "STATE OFF");
+						app_wdt_feed();
+						report = app_execute(response, &latency);
+						app_wdt_feed();
+					}
 
-						/* Response */
-						if (app_response == APP_RESPONSE_REPORT ||
-						    app_response == APP_RESPONSE_PRESS) {
-							bool state;
-
-							if (app_response == APP_RESPONSE_PRESS)
-								app_relay_on(2000);
-
-							state = app_adc_detect();
-							printf("Detect state: %s\n", state ? "ON" : "OFF");
-							ret = gitt_commit_event(&app.g, state ? "STATE ON" : "STATE OFF");
-							printf("Commit event result: %s\n", GITT_ERRNO_STR(ret));
-							app_response = APP_RESPONSE_NONE;
-							printf("Free heap size: %dbytes\n", esp_get_free_heap_size());
-						}
+					/* Push local reports and what was journaled while offline */
+					if (app_journal_pending())
+						app_journal_flush(app_commit_event);
+					app_wdt_feed();
+
+					if (report != APP_REPORT_NONE) {
+						char *event = report ? "STATE ON" : "STATE OFF";
+						char message[48];
+
+						/* Keep the plain event first so it can still be matched */
+						if (latency >= 0)
+							sprintf(message, "%s (press to DET %d ms)", event, latency);
+						else
+							strcpy(message, event);
+
+						if (app_commit_event(message))
+							app_journal_append(event);
+						app_wdt_feed();
+						APP_LOG("Free heap size: %dbytes\n", esp_get_free_heap_size());
 					}
-					vTaskDelay(1000 / portTICK_PERIOD_MS);
-					count++;
-					if (count >= app.interval)
-						count = 0;
 
-					app_wdt_count = 0;
+					/* Daily history summary, kept until it is pushed */
+					if (app_history_summary(summary, sizeof(summary)) &&
+					    !app_commit_event(summary))
+						app_history_summary_done(summary);
+					app_wdt_feed();
+					app_poll_record(start);
 				}
 				app_led_red_on();
 			}
 
-			printf("\nServer stoped\n");
+			APP_LOG("\nServer stoped\n");
 			xEventGroupSetBits(app_event_group, APP_EVENT_SERVER_STOPED);
 			break;
 		case APP_STATE_SERVER_STOP:
+			app_main_wait(portMAX_DELAY);
+			app_local_press_journal();
 			break;
 		}
-
-		vTaskDelay(1000 / portTICK_PERIOD_MS);
 	}
 
 	vTaskDelete(NULL);
 }
 
-static void task_show(void)
-{
-	char buffer[2048];
-
-	vTaskList(buffer);
-	printf("NAME\t\tSTATE\tPRIO\tHIGH\tNUMBER\n");
-	printf("----\t\t-----\t----\t----\t------\n");
-	printf("%s", buffer);
-}
-
 static void config_show(void)
 {
 	time_t now = 0;
@@ -220,6 +634,23 @@ static void config_show(void)
 	printf("Loop interval : %d second\n", app.interval);
 	printf("Repository    : %s\n", app.repository);
 	printf("Server state  : %s\n", app_state ? "running" : "stoped");
+	printf("Log dropped   : %u\n", app_log_dropped());
+	printf("LAN command   : %s (UDP %d)\n", app_lan_enabled() ? "on" : "off", APP_LAN_PORT);
+	printf("Journal       : %d pending\n", app_journal_pending());
+	if (app_press_stat.count)
+		printf("Press latency : %u ms min, %u ms avg, %u ms max, %u presses, %u timeouts\n",
+		       app_press_stat.min, app_press_stat.total / app_press_stat.count,
+		       app_press_stat.max, app_press_stat.count, app_press_stat.timeout);
+	else
+		printf("Press latency : no data, %u timeouts\n", app_press_stat.timeout);
+	if (app_poll_stat.count) {
+		printf("Boot time     : %u ms to the first successful poll\n", app_poll_stat.boot);
+		printf("Poll cycle    : %u ms min, %u ms avg, %u ms max, %u polls\n",
+		       app_poll_stat.min, app_poll_stat.total / app_poll_stat.count,
+		       app_poll_stat.max, app_poll_stat.count);
+	} else {
+		printf("Poll cycle    : no data\n");
+	}
 	printf("Private key   : \n%s\n\n", app.privkey);
 }
 
@@ -247,6 +678,11 @@ static void help_show(void)
 	printf("  start                 - Start server\n");
 	printf("  stop                  - Stop server\n");
 	printf("  task                  - List task information\n");
+	printf("  top [1-60]            - Show CPU usage and stack headroom per task\n");
+	printf("  log                   - Dump deferred log history\n");
+	printf("  lan <on|off>          - Enable or disable LAN command fast path\n");
+	printf("  history [YYYY/MM/DD]  - Show power state transitions and uptime of a day\n");
+	printf("  schedule              - List scheduled actions\n");
 	printf("  help                  - Show help message\n");
 }
 
@@ -261,6 +697,7 @@ static void app_server_start(void)
 		old_state = app_state;
 		xEventGroupClearBits(app_event_group, APP_EVENT_SERVER_STARTED);
 		app_state = APP_STATE_SERVER_START;
+		app_main_notify(APP_NOTIFY_STATE);
 		bits = xEventGroupWaitBits(app_event_group,
 					   APP_EVENT_SERVER_STARTED,
 					   pdFALSE,
@@ -284,6 +721,7 @@ static void app_server_stop(void)
 		old_state = app_state;
 		xEventGroupClearBits(app_event_group, APP_EVENT_SERVER_STOPED);
 		app_state = APP_STATE_SERVER_STOP;
+		app_main_notify(APP_NOTIFY_STATE);
 		bits = xEventGroupWaitBits(app_event_group,
 					   APP_EVENT_SERVER_STOPED,
 					   pdFALSE,
@@ -432,6 +870,7 @@ static void usb_serial_task(void *arg)
 					} else {
 						strcpy(app.privkey, data);
 						app_spiffs_save("privkey", app.privkey, strlen(app.privkey));
+						app_main_notify(APP_NOTIFY_CONFIG);
 						printf("\nSaved\n");
 					}
 
@@ -449,6 +888,7 @@ static void usb_serial_task(void *arg)
 						printf("Invalid parameter\n");
 					} else {
 						app_spiffs_save("repository", app.repository, strlen(app.repository));
+						app_main_notify(APP_NOTIFY_CONFIG);
 						printf("Changed\n");
 					}
 					if (old_state == APP_STATE_SERVER_START)
@@ -471,7 +911,44 @@ static void usb_serial_task(void *arg)
 					help_show();
 					index = 0;
 				} else if (index >= 4 && !memcmp("task", buff, 4)) {
-					task_show();
+					app_task_show();
+					index = 0;
+				} else if (index >= 3 && !memcmp("top", buff, 3)) {
+					int seconds = 5;
+
+					sscanf(buff, "%*s%d", &seconds);
+					app_task_top(seconds > 0 ? seconds : 5);
+					index = 0;
+				} else if (index >= 3 && !memcmp("log", buff, 3)) {
+					app_log_dump();
+					index = 0;
+				} else if (index >= 7 && !memcmp("history", buff, 7)) {
+					struct tm day = { 0 };
+
+					ret = sscanf(buff, "%*s%d/%d/%d", &day.tm_year, &day.tm_mon, &day.tm_mday);
+					if (ret == 3) {
+						day.tm_year -= 1900;
+						day.tm_mon -= 1;
+						day.tm_hour = 12;
+						app_history_show(mktime(&day));
+					} else {
+						app_history_show(time(NULL));
+					}
+					index = 0;
+				} else if (index >= 8 && !memcmp("schedule", buff, 8)) {
+					app_sched_show();
+					index = 0;
+				} else if (index >= 3 && !memcmp("lan", buff, 3)) {
+					char mode[4] = "";
+
+					ret = sscanf(buff, "%*s%3s", mode);
+					if (ret < 1 || (strcmp(mode, "on") && strcmp(mode, "off"))) {
+						printf("Invalid parameter\n");
+					} else {
+						app_lan_enable(!strcmp(mode, "on"));
+						app_spiffs_save("lan", mode, strlen(mode));
+						printf("Changed\n");
+					}
 					index = 0;
 				} else if (index) {
 					printf("Unknown command: %s\n\n", buff);
@@ -528,43 +1005,63 @@ static void chip_info_show(void)
 
 static void app_wdt_task(void *pvParameters)
 {
+	int left;
+
+	app_wdt_handle = xTaskGetCurrentTaskHandle();
 	printf("Application watchdog started\n");
 
 	while (1) {
-		vTaskDelay(1000 / portTICK_PERIOD_MS);
+		/* Only a running server is watched, app_main_task feeds on start and stop */
+		if (app_state != APP_STATE_SERVER_START) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
 
-		if (app_state == APP_STATE_SERVER_START)
-			app_wdt_count++;
-		else
-			app_wdt_count = 0;
+		if (ulTaskNotifyTake(pdTRUE, (APP_WDT_TIMEOUT - APP_WDT_WARN) * 1000 / portTICK_PERIOD_MS))
+			continue;
 
-		if (app_wdt_count >= APP_WDT_TIMEOUT - 5) {
+		for (left = APP_WDT_WARN; left > 0; left--) {
 			ESP_LOGE(TAG, "The service seems to be hung. Reset the system after %d seconds.",
-				 APP_WDT_TIMEOUT - app_wdt_count);
+				 left);
+			if (ulTaskNotifyTake(pdTRUE, 1000 / portTICK_PERIOD_MS))
+				break;
 		}
 
-		if (app_wdt_count == APP_WDT_TIMEOUT)
+		if (!left)
 			esp_restart();
 	}
 }
 
 void app_main(void)
 {
+	char lan_mode[4];
+
 	chip_info_show();
 	app_nvs_init();
 	app_led_init();
 	app_relay_init();
 	app_spiffs_init();
 	app_adc_init();
-	app_wifi_init();
+	app_wifi_init(app_wifi_callback);
 	app_time_init();
+	app_log_init();
 
 	app_spiffs_load("repository", app.repository, sizeof(app.repository));
 	app_spiffs_load("privkey", app.privkey, sizeof(app.privkey));
+	app_journal_init();
+	app_history_init();
+	if (!app_spiffs_load("lan", lan_mode, sizeof(lan_mode)))
+		app_lan_enable(!strcmp(lan_mode, "on"));
 
 	app_event_group = xEventGroupCreate();
 	ESP_ERROR_CHECK(app_event_group == NULL);
 
+	app_exec_lock = xSemaphoreCreateMutex();
+	ESP_ERROR_CHECK(app_exec_lock == NULL);
+
+	app_lan_init(app.g.device.id, app.privkey, app_local_command);
+	app_sched_init(app_local_command);
+
 	config_show();
 
 	xTaskCreate(app_main_task, "app_main_task", 1024 * 20, NULL, 5, NULL);
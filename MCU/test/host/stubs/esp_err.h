@@ -0,0 +1,10 @@
+/* Host stub */
+#ifndef __STUB_ESP_ERR_H_
+#define __STUB_ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK			0
+#define ESP_ERROR_CHECK(x)	do { if (x) abort(); } while (0)
+
+#endif /* __STUB_ESP_ERR_H_ */
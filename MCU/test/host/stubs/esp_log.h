@@ -0,0 +1,12 @@
+/* Host stub */
+#ifndef __STUB_ESP_LOG_H_
+#define __STUB_ESP_LOG_H_
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, fmt, ...)	printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)	printf("W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)	printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)	do { } while (0)
+
+#endif /* __STUB_ESP_LOG_H_ */
@@ -0,0 +1,21 @@
+/* Host stub, bitwise CRC-32 (IEEE 802.3) as in the ROM */
+#ifndef __STUB_ESP_ROM_CRC_H_
+#define __STUB_ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	int i;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+#endif /* __STUB_ESP_ROM_CRC_H_ */
@@ -0,0 +1,17 @@
+/* Host stub, only what the modules under test use */
+#ifndef __STUB_FREERTOS_H_
+#define __STUB_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE			1
+#define pdFALSE			0
+#define portTICK_PERIOD_MS	10
+#define portMAX_DELAY		0xffffffffu
+#define BIT0			(1 << 0)
+#define BIT1			(1 << 1)
+
+#endif /* __STUB_FREERTOS_H_ */
@@ -0,0 +1,24 @@
+/* Host stub, the tests are single threaded */
+#ifndef __STUB_SEMPHR_H_
+#define __STUB_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	return (SemaphoreHandle_t)1;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+	return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	return pdTRUE;
+}
+
+#endif /* __STUB_SEMPHR_H_ */
@@ -0,0 +1,14 @@
+/* Host stub, only what the modules under test use */
+#ifndef __STUB_TASK_H_
+#define __STUB_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack,
+		       void *param, int prio, TaskHandle_t *handle);
+void vTaskDelay(TickType_t ticks);
+
+#endif /* __STUB_TASK_H_ */
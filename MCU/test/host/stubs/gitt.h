@@ -0,0 +1,37 @@
+/* Host stub, only what the modules under test use */
+#ifndef __STUB_GITT_H_
+#define __STUB_GITT_H_
+
+#include <stdint.h>
+#include "gitt_type.h"
+
+#define GITT_DEVICE_NAME_SIZE		32
+#define GITT_DEVICE_ID_SIZE		17
+
+struct gitt_device {
+	char name[GITT_DEVICE_NAME_SIZE];
+	char id[GITT_DEVICE_ID_SIZE];
+};
+
+struct gitt_repository {
+	char head[64];
+	char refs[64];
+};
+
+struct gitt {
+	struct gitt_device device;
+	struct gitt_repository repository;
+	char *privkey;
+	char *url;
+	uint8_t *buf;
+	int buf_len;
+	void (*remote_event)(struct gitt *g, struct gitt_device *device,
+			     char *date, char *zone, char *event);
+	int (*get_date)(char *buf, uint8_t size);
+	int (*get_zone)(char *buf, uint8_t size);
+};
+
+int gitt_init(struct gitt *g);
+int gitt_update_event(struct gitt *g);
+
+#endif /* __STUB_GITT_H_ */
@@ -0,0 +1,7 @@
+/* Host stub, only what the modules under test use */
+#ifndef __STUB_GITT_ERRNO_H_
+#define __STUB_GITT_ERRNO_H_
+
+#define GITT_ERRNO_STR(err)	((err) ? "error" : "success")
+
+#endif /* __STUB_GITT_ERRNO_H_ */
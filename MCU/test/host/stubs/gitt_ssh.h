@@ -0,0 +1 @@
+/* Host stub, included by app headers but not needed by the tests */
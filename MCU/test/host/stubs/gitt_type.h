@@ -0,0 +1,9 @@
+/* Host stub, only what the modules under test use */
+#ifndef __STUB_GITT_TYPE_H_
+#define __STUB_GITT_TYPE_H_
+
+#include <stddef.h>
+
+#define gitt_containerof(ptr, type, member)	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#endif /* __STUB_GITT_TYPE_H_ */
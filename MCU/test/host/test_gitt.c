@@ -0,0 +1,202 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test of the handled remote event ring, build and run with "make"
+ * in this directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t test_now;
+#define time(t)		((time_t)test_now)
+
+#include "app_gitt.c"
+
+#define SYNC_TIME	1760832000	/* 2025/10/19 00:00:00 UTC */
+
+static int failures;
+
+#define CHECK(cond)	do {								\
+	if (!(cond)) {									\
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);			\
+		failures++;								\
+	}										\
+} while (0)
+
+/* Fakes of the modules app_gitt.c depends on */
+static char spiffs_data[sizeof(struct app_gitt_seen)];
+static int spiffs_size = -1;
+static int saves;
+
+int app_spiffs_save_atomic(char *name, char *data, int size)
+{
+	memcpy(spiffs_data, data, size);
+	spiffs_size = size;
+	saves++;
+	return 0;
+}
+
+int app_spiffs_load_atomic(char *name, char *buff, int size)
+{
+	if (spiffs_size < 0)
+		return -1;
+	memcpy(buff, spiffs_data, spiffs_size);
+	buff[spiffs_size] = '\0';
+	return spiffs_size;
+}
+
+void app_log_write(const char *fmt, ...)
+{
+}
+
+void app_log_write_text(const char *fmt, const char *text)
+{
+}
+
+void app_task_record_kex_stack(void)
+{
+}
+
+int gitt_init(struct gitt *g)
+{
+	return 0;
+}
+
+int gitt_update_event(struct gitt *g)
+{
+	return 0;
+}
+
+static struct app_gitt app;
+static int handled;
+
+static bool callback(char *data)
+{
+	if (strncmp(data, "PRESS", 5) && strncmp(data, "REPORT", 6))
+		return false;
+
+	handled++;
+	return true;
+}
+
+/* Power cycle: RAM is lost, SPIFFS is kept */
+static void reboot(uint32_t now)
+{
+	memset(&app, 0, sizeof(app));
+	strcpy(app.g.device.id, "0000000000000001");
+	test_now = now;
+	app_gitt_init(&app, callback);
+	app_gitt_update(&app);
+}
+
+/* Deliver one remote event of another device, return true if it ran */
+static bool deliver(const char *id, uint32_t date, const char *text)
+{
+	struct gitt_device device = { .name = "test" };
+	char stamp[16];
+	char event[64];
+	int before = handled;
+
+	strcpy(device.id, id);
+	sprintf(stamp, "%u", date);
+	strcpy(event, text);
+	app.g.remote_event(&app.g, &device, stamp, "+0800", event);
+
+	return handled != before;
+}
+
+/* A command runs once, also when delivered again after a reboot */
+static void test_once(void)
+{
+	spiffs_size = -1;
+	reboot(SYNC_TIME);
+
+	CHECK(deliver("0000000000000002", SYNC_TIME - 10, "PRESS"));
+	CHECK(!deliver("0000000000000002", SYNC_TIME - 10, "PRESS"));
+	/* Same text and date from another device is another command */
+	CHECK(deliver("0000000000000003", SYNC_TIME - 10, "PRESS"));
+	/* Sent long before the first boot */
+	CHECK(!deliver("0000000000000002", SYNC_TIME - 3600, "PRESS"));
+
+	app_gitt_update(&app);
+	reboot(SYNC_TIME + 60);
+	CHECK(!deliver("0000000000000002", SYNC_TIME - 10, "PRESS"));
+	CHECK(deliver("0000000000000002", SYNC_TIME + 50, "REPORT"));
+}
+
+/* State reports of other devices are neither remembered nor saved */
+static void test_reports(void)
+{
+	uint32_t head;
+	int i;
+
+	spiffs_size = -1;
+	reboot(SYNC_TIME);
+	head = app.seen.head;
+	saves = 0;
+
+	for (i = 0; i < APP_GITT_SEEN_EVENTS * 2; i++)
+		CHECK(!deliver("0000000000000002", SYNC_TIME + i, "STATE ON"));
+	app_gitt_update(&app);
+
+	CHECK(app.seen.head == head);
+	CHECK(saves == 0);
+}
+
+/* An event dated far in the future does not block later commands */
+static void test_future(void)
+{
+	int i;
+
+	spiffs_size = -1;
+	reboot(SYNC_TIME);
+
+	CHECK(deliver("0000000000000002", SYNC_TIME + 30 * 24 * 3600, "PRESS"));
+	/* Push it out of the ring */
+	for (i = 0; i < APP_GITT_SEEN_EVENTS; i++) {
+		test_now++;
+		CHECK(deliver("0000000000000003", test_now, "PRESS"));
+	}
+
+	CHECK(app.seen.floor < test_now);
+	test_now += 60;
+	CHECK(deliver("0000000000000002", test_now, "PRESS"));
+}
+
+int main(void)
+{
+	test_once();
+	test_reports();
+	test_future();
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test of the DET history with a simulated clock, build and run
+ * with "make" in this directory. The history file is redirected to a
+ * temporary directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint32_t test_now;
+#define time(t)		((time_t)test_now)
+
+static char test_dir[] = "/tmp/history.XXXXXX";
+static FILE *test_fopen(const char *path, const char *mode);
+#define fopen(path, mode)	test_fopen(path, mode)
+
+#include "app_history.c"
+
+#undef fopen
+
+#define SYNC_TIME	1760832000	/* 2025/10/19 00:00:00 UTC */
+#define HOUR		3600
+
+static int failures;
+
+#define CHECK(cond)	do {								\
+	if (!(cond)) {									\
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);			\
+		failures++;								\
+	}										\
+} while (0)
+
+static FILE *test_fopen(const char *path, const char *mode)
+{
+	char real[128];
+
+	if (!strncmp(path, "/spiffs/", 8)) {
+		sprintf(real, "%s/%s", test_dir, path + 8);
+		return fopen(real, mode);
+	}
+
+	return fopen(path, mode);
+}
+
+/* Fakes of the modules app_history.c depends on */
+bool app_adc_detect(void)
+{
+	return false;
+}
+
+int app_adc_get_voltage(void)
+{
+	return 0;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack,
+		       void *param, int prio, TaskHandle_t *handle)
+{
+	return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+}
+
+/* Power cycle: RAM is lost, the file is kept */
+static void reboot(void)
+{
+	history_last = 0;
+	history_dirty = false;
+	history_summary_pending = false;
+	app_history_init();
+}
+
+/* Start over with an empty history file */
+static void erase(void)
+{
+	char path[64];
+
+	sprintf(path, "%s/history", test_dir);
+	unlink(path);
+	reboot();
+}
+
+/* What app_history_task does for one sample */
+static void sample(uint32_t now, bool state, int mv)
+{
+	test_now = now;
+	app_history_append(now, state, mv);
+}
+
+struct decoded {
+	int count;
+	uint32_t time[16];
+	bool state[16];
+	int mv[16];
+};
+
+static void decode_visit(uint32_t time, bool state, int mv, void *arg)
+{
+	struct decoded *d = arg;
+
+	if (d->count < 16) {
+		d->time[d->count] = time;
+		d->state[d->count] = state;
+		d->mv[d->count] = mv;
+	}
+	d->count++;
+}
+
+/* Deltas of every varint length come back unchanged */
+static void test_varint(void)
+{
+	static const uint32_t delta[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 300000000 };
+	struct decoded d = { 0 };
+	uint32_t now = SYNC_TIME;
+	int n = sizeof(delta) / sizeof(delta[0]);
+	int i;
+
+	erase();
+	for (i = 0; i < n; i++) {
+		now += delta[i];
+		sample(now, i & 1, i * HISTORY_VOLTAGE_STEP);
+	}
+
+	app_history_decode(&history_block, decode_visit, &d);
+	CHECK(d.count == n);
+	now = SYNC_TIME;
+	for (i = 0; i < n && i < 16; i++) {
+		now += delta[i];
+		CHECK(d.time[i] == now);
+		CHECK(d.state[i] == (i & 1));
+		CHECK(d.mv[i] == i * HISTORY_VOLTAGE_STEP);
+	}
+}
+
+/* Time without samples, e.g. while powered off, is neither on nor off */
+static void test_gap(void)
+{
+	struct app_history_stat st;
+	uint32_t t;
+
+	erase();
+	/* On from 01:00 to 03:00 */
+	for (t = SYNC_TIME + HOUR; t <= SYNC_TIME + 3 * HOUR; t += HISTORY_VOLTAGE_PERIOD)
+		sample(t, true, 3300);
+	/* Nothing recorded until 06:00, then off until 08:00 */
+	for (t = SYNC_TIME + 6 * HOUR; t <= SYNC_TIME + 8 * HOUR; t += HISTORY_VOLTAGE_PERIOD)
+		sample(t, false, 0);
+
+	test_now = SYNC_TIME + 8 * HOUR;
+	app_history_stat(&st, SYNC_TIME, false);
+	CHECK(st.on == 2 * HOUR);
+	CHECK(st.known == 4 * HOUR);
+	CHECK(st.transitions == 1);
+}
+
+/* A day only counts what happened between its midnights */
+static void test_midnight(void)
+{
+	struct app_history_stat st;
+
+	erase();
+	sample(SYNC_TIME - 20 * 60, false, 0);
+	sample(SYNC_TIME - 10 * 60, true, 3300);
+	sample(SYNC_TIME + 10 * 60, false, 0);
+	sample(SYNC_TIME + 20 * 60, true, 3300);
+
+	test_now = SYNC_TIME + 30 * 60;
+	app_history_stat(&st, SYNC_TIME - HISTORY_DAY, false);
+	CHECK(st.transitions == 1);
+	CHECK(st.on == 10 * 60);
+	CHECK(st.known == 20 * 60);
+
+	app_history_stat(&st, SYNC_TIME, false);
+	CHECK(st.transitions == 2);
+	CHECK(st.on == 10 * 60 + 10 * 60);
+	CHECK(st.known == 30 * 60);
+}
+
+/* After a reboot the newest block is continued, also after the ring wrapped */
+static void test_reload(void)
+{
+	uint32_t now = SYNC_TIME;
+	uint32_t seq;
+	uint32_t last;
+
+	erase();
+	while (history_block.seq < HISTORY_BLOCKS + 3) {
+		now += HISTORY_VOLTAGE_PERIOD;
+		sample(now, (now / HISTORY_VOLTAGE_PERIOD) & 1, 3300);
+	}
+	app_history_write(&history_block);
+	seq = history_block.seq;
+	last = history_last;
+
+	reboot();
+	CHECK(history_block.seq == seq);
+	CHECK(history_last == last);
+
+	/* The next sample goes on in the same block */
+	sample(now + HISTORY_VOLTAGE_PERIOD, true, 3300);
+	CHECK(history_block.seq == seq);
+}
+
+/* The summary is copied out, and a newer one is not lost by an old push */
+static void test_summary(void)
+{
+	char buf[64];
+	char old[64];
+	uint32_t t;
+
+	erase();
+	for (t = SYNC_TIME - 2 * HOUR; t <= SYNC_TIME; t += HISTORY_VOLTAGE_PERIOD)
+		sample(t, t < SYNC_TIME - HOUR, t < SYNC_TIME - HOUR ? 3300 : 0);
+	CHECK(!app_history_summary(buf, sizeof(buf)));
+
+	app_history_summarize(SYNC_TIME - HISTORY_DAY);
+	CHECK(app_history_summary(old, sizeof(old)));
+	CHECK(!strcmp(old, "SUMMARY 2025/10/18 ON 50.0% TRANSITIONS 1"));
+
+	sample(SYNC_TIME + HISTORY_VOLTAGE_PERIOD, true, 3300);
+	test_now = SYNC_TIME + HISTORY_DAY;
+	app_history_summarize(SYNC_TIME);
+	app_history_summary_done(old);
+	CHECK(app_history_summary(buf, sizeof(buf)));
+	app_history_summary_done(buf);
+	CHECK(!app_history_summary(buf, sizeof(buf)));
+}
+
+int main(void)
+{
+	char cmd[64];
+
+	if (!mkdtemp(test_dir))
+		return 1;
+	setenv("TZ", "UTC0", 1);
+	tzset();
+
+	test_varint();
+	test_gap();
+	test_midnight();
+	test_reload();
+	test_summary();
+
+	sprintf(cmd, "rm -r %s", test_dir);
+	system(cmd);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+
+	return failures ? 1 : 0;
+}
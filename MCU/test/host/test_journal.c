@@ -0,0 +1,186 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test of the push journal, build and run with "make" in this
+ * directory. SPIFFS paths are redirected to a temporary directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char test_dir[] = "/tmp/journal.XXXXXX";
+static FILE *test_fopen(const char *path, const char *mode);
+#define fopen(path, mode)	test_fopen(path, mode)
+
+#include "app_journal.c"
+
+static int failures;
+
+#define CHECK(cond)	do {								\
+	if (!(cond)) {									\
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);			\
+		failures++;								\
+	}										\
+} while (0)
+
+#undef fopen
+
+static FILE *test_fopen(const char *path, const char *mode)
+{
+	char real[128];
+
+	if (!strncmp(path, "/spiffs/", 8)) {
+		sprintf(real, "%s/%s", test_dir, path + 8);
+		return fopen(real, mode);
+	}
+
+	return fopen(path, mode);
+}
+
+/* Fakes of the modules app_journal.c depends on */
+int app_spiffs_save_atomic(char *name, char *data, int size)
+{
+	char path[64];
+	FILE *f;
+
+	sprintf(path, "/spiffs/%s", name);
+	f = test_fopen(path, "wb");
+	if (!f)
+		return -1;
+	fwrite(data, 1, size, f);
+	fclose(f);
+
+	return 0;
+}
+
+int app_spiffs_load_atomic(char *name, char *buff, int size)
+{
+	char path[64];
+	FILE *f;
+	int ret;
+
+	sprintf(path, "/spiffs/%s", name);
+	f = test_fopen(path, "rb");
+	if (!f)
+		return -1;
+	ret = fread(buff, 1, size - 1, f);
+	fclose(f);
+	buff[ret] = '\0';
+
+	return ret ? ret : -1;
+}
+
+static bool online;
+static int commits;
+static char pushed[1024];
+
+static int commit(char *message)
+{
+	if (!online)
+		return -1;
+
+	commits++;
+	strcpy(pushed, message);
+	return 0;
+}
+
+/* Power cycle: RAM is lost, the files are kept */
+static void reboot(void)
+{
+	journal_ack = 0;
+	journal_next = 1;
+	app_journal_init();
+}
+
+/* Local reports made while offline are all kept, in order */
+static void test_offline(void)
+{
+	reboot();
+	online = false;
+
+	app_journal_append("STATE ON");
+	app_journal_append("STATE OFF");
+	app_journal_append("STATE ON");
+	CHECK(app_journal_pending() == 3);
+
+	CHECK(app_journal_flush(commit) != 0);
+	CHECK(app_journal_pending() == 3);
+
+	/* Survives a reboot before the network is back */
+	reboot();
+	CHECK(app_journal_pending() == 3);
+
+	online = true;
+	CHECK(app_journal_flush(commit) == 0);
+	CHECK(commits == 1);
+	CHECK(!strncmp(pushed, "STATE ON @", 10));
+	CHECK(strstr(pushed, "\nSTATE OFF @") != NULL);
+	CHECK(app_journal_pending() == 0);
+
+	/* The ack is persisted, nothing is pushed twice */
+	reboot();
+	CHECK(app_journal_pending() == 0);
+	CHECK(app_journal_flush(commit) == 0);
+	CHECK(commits == 1);
+}
+
+/* More records than the ring holds, the oldest are dropped */
+static void test_wrap(void)
+{
+	int i;
+
+	reboot();
+	online = false;
+	for (i = 0; i < JOURNAL_RECORDS + 10; i++)
+		app_journal_append(i & 1 ? "STATE ON" : "STATE OFF");
+
+	online = true;
+	commits = 0;
+	while (app_journal_pending() && commits < 10)
+		CHECK(app_journal_flush(commit) == 0);
+	CHECK(app_journal_pending() == 0);
+	CHECK(commits <= (JOURNAL_RECORDS + JOURNAL_BATCH - 1) / JOURNAL_BATCH);
+}
+
+int main(void)
+{
+	char cmd[64];
+
+	if (!mkdtemp(test_dir))
+		return 1;
+
+	test_offline();
+	test_wrap();
+
+	sprintf(cmd, "rm -r %s", test_dir);
+	system(cmd);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+
+	return failures ? 1 : 0;
+}
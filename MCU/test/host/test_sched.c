@@ -0,0 +1,281 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host test of the schedule timer wheel with a simulated clock, build
+ * and run with "make" in this directory.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t test_now;
+#define time(t)		((time_t)test_now)
+
+#include "app_sched.c"
+
+#define DAY		(24 * 3600)
+#define SYNC_TIME	1760832000	/* 2025/10/19 00:00:00 UTC */
+
+static int failures;
+
+#define CHECK(cond)	do {								\
+	if (!(cond)) {									\
+		printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);			\
+		failures++;								\
+	}										\
+} while (0)
+
+/* Fakes of the modules app_sched.c depends on */
+static char spiffs_data[sizeof(sched_actions)];
+static int spiffs_size = -1;
+static bool adc_state;
+static int runs;
+static char last_cmd[8];
+static bool busy;
+
+int app_spiffs_save_atomic(char *name, char *data, int size)
+{
+	memcpy(spiffs_data, data, size);
+	spiffs_size = size;
+	return 0;
+}
+
+int app_spiffs_load_atomic(char *name, char *buff, int size)
+{
+	if (spiffs_size < 0)
+		return -1;
+	memcpy(buff, spiffs_data, spiffs_size);
+	buff[spiffs_size] = '\0';
+	return spiffs_size;
+}
+
+bool app_adc_detect(void)
+{
+	return adc_state;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack,
+		       void *param, int prio, TaskHandle_t *handle)
+{
+	return pdTRUE;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+}
+
+static int handler(const char *cmd)
+{
+	if (busy)
+		return -1;
+
+	runs++;
+	strcpy(last_cmd, cmd);
+	if (!strcmp(cmd, "PRESS"))
+		adc_state = !adc_state;
+	return adc_state;
+}
+
+/* Power cycle: RAM is lost, SPIFFS is kept */
+static void reboot(uint32_t now)
+{
+	memset(sched_actions, 0, sizeof(sched_actions));
+	sched_tick = 0;
+	test_now = now;
+	app_sched_init(handler);
+}
+
+/* Let the scheduler task run once a second for a while */
+static void run_for(uint32_t seconds)
+{
+	while (seconds--) {
+		test_now++;
+		app_sched_step(test_now);
+	}
+}
+
+static int pending(void)
+{
+	int count = 0;
+	int i;
+
+	for (i = 0; i < SCHED_ACTIONS; i++)
+		count += !!sched_actions[i].due;
+
+	return count;
+}
+
+static void test_after(void)
+{
+	reboot(SYNC_TIME);
+	runs = 0;
+
+	CHECK(app_sched_command("AFTER 3 REPORT"));
+	run_for(179);
+	CHECK(runs == 0);
+	run_for(1);
+	CHECK(runs == 1 && !strcmp(last_cmd, "REPORT"));
+	run_for(600);
+	CHECK(runs == 1);
+	CHECK(pending() == 0);
+}
+
+/* Anything but a whole positive number of minutes is rejected */
+static void test_after_invalid(void)
+{
+	reboot(SYNC_TIME);
+
+	CHECK(app_sched_command("AFTER abc PRESS"));
+	CHECK(app_sched_command("AFTER 5x PRESS"));
+	CHECK(app_sched_command("AFTER 0 PRESS"));
+	CHECK(app_sched_command("AFTER -3 PRESS"));
+	CHECK(pending() == 0);
+}
+
+/* A busy handler, e.g. a press still timed by the poll loop, is retried */
+static void test_busy(void)
+{
+	reboot(SYNC_TIME);
+	runs = 0;
+
+	app_sched_command("AFTER 1 REPORT");
+	busy = true;
+	run_for(60);
+	CHECK(runs == 0);
+	CHECK(pending() == 1);
+
+	busy = false;
+	run_for(SCHED_RETRY);
+	CHECK(runs == 1);
+	CHECK(pending() == 0);
+
+	/* Given up once it is too late */
+	app_sched_command("AFTER 1 REPORT");
+	busy = true;
+	run_for(60 + SCHED_LATE_LIMIT + SCHED_RETRY);
+	CHECK(pending() == 0);
+	busy = false;
+	run_for(600);
+	CHECK(runs == 1);
+}
+
+static void test_at_ifoff(void)
+{
+	reboot(SYNC_TIME + 6 * 3600);
+	runs = 0;
+	adc_state = false;
+
+	/* Delivered twice, kept once */
+	app_sched_command("AT 07:00 PRESS IFOFF");
+	app_sched_command("AT 07:00 PRESS IFOFF");
+	app_sched_command("AT 07:05 PRESS IFOFF");
+	CHECK(pending() == 2);
+
+	/* The first press turns it on, the second one is skipped */
+	run_for(3600 + 300);
+	CHECK(runs == 1);
+	CHECK(adc_state);
+	CHECK(pending() == 0);
+}
+
+static void test_cancel(void)
+{
+	reboot(SYNC_TIME);
+	runs = 0;
+
+	app_sched_command("AFTER 1 PRESS");
+	app_sched_command("AFTER 2 REPORT");
+	CHECK(app_sched_command("CANCEL"));
+	run_for(300);
+	CHECK(runs == 0);
+	CHECK(pending() == 0);
+}
+
+/* Rebooted shortly after a due time, with a valid clock */
+static void test_reboot_late(void)
+{
+	reboot(SYNC_TIME);
+	runs = 0;
+
+	app_sched_command("AFTER 1 REPORT");
+	reboot(SYNC_TIME + 60 + 200);
+	run_for(1);
+	CHECK(runs == 1);
+	CHECK(pending() == 0);
+}
+
+/*
+ * Power cut for days: the clock restarts near 1970, saved actions are
+ * linked before SNTP has synced, then time jumps forward. Only actions
+ * missed by less than SCHED_LATE_LIMIT may run.
+ */
+static void test_cold_boot(void)
+{
+	reboot(SYNC_TIME);
+	runs = 0;
+
+	app_sched_command("AFTER 10 PRESS");		/* Due two days before the sync */
+	test_now = SYNC_TIME + 2 * DAY - 300;
+	app_sched_command("AFTER 3 REPORT");		/* Due two minutes before the sync */
+	CHECK(pending() == 2);
+
+	reboot(10);
+	run_for(30);
+	CHECK(runs == 0);
+	CHECK(pending() == 2);
+
+	/* SNTP synchronized */
+	test_now = SYNC_TIME + 2 * DAY;
+	run_for(1);
+	CHECK(runs == 1 && !strcmp(last_cmd, "REPORT"));
+	CHECK(pending() == 0);
+
+	/* The stale press was dropped from SPIFFS as well */
+	reboot(SYNC_TIME + 2 * DAY + 1);
+	CHECK(pending() == 0);
+	run_for(SCHED_SLOTS * 2);
+	CHECK(runs == 1);
+}
+
+int main(void)
+{
+	setenv("TZ", "UTC0", 1);
+	tzset();
+
+	test_after();
+	test_after_invalid();
+	test_busy();
+	test_at_ifoff();
+	test_cancel();
+	test_reboot_late();
+	test_cold_boot();
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# MIT License
+#
+# Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+#
+# LAN command client for the ESP32-C3 remote switch.
+#
+# Usage: lan_client.py <device-ip> <device-id> <private-key-file> <PRESS|REPORT> [count]
+#
+
+import hashlib
+import hmac
+import socket
+import struct
+import sys
+import time
+
+PORT = 3721
+CMD_SIZE = 8
+MAC_SIZE = 32
+TIMEOUT = 5
+
+
+def derive_key(path):
+    with open(path, 'rb') as f:
+        return hashlib.sha256(f.read().strip()).digest()
+
+
+def mac(key, device, body):
+    """The device id is covered by the MAC but not sent."""
+    return hmac.new(key, device + body, hashlib.sha256).digest()
+
+
+def sign(key, device, cmd, stamp):
+    body = cmd + struct.pack('<Q', stamp)
+    return body + mac(key, device, body)
+
+
+def recv_reply(sock, key, device, stamp, deadline):
+    """Wait for the reply to the request sent with stamp, dropping late
+    replies to earlier requests, e.g. a PRESS that outlasted the timeout."""
+    while True:
+        left = deadline - time.perf_counter()
+        if left <= 0:
+            return None
+        sock.settimeout(left)
+        try:
+            reply, _ = sock.recvfrom(CMD_SIZE + 8 + MAC_SIZE)
+        except socket.timeout:
+            return None
+
+        body, sig = reply[:-MAC_SIZE], reply[-MAC_SIZE:]
+        if not hmac.compare_digest(sig, mac(key, device, body)):
+            print('Bad reply signature')
+            continue
+        if struct.unpack('<Q', body[CMD_SIZE:CMD_SIZE + 8])[0] != stamp:
+            print('Drop stale reply')
+            continue
+        return body
+
+
+def main():
+    if len(sys.argv) < 5:
+        print('Usage: lan_client.py <device-ip> <device-id> <private-key-file> <PRESS|REPORT> [count]')
+        return 1
+
+    host, device, keyfile, cmd = sys.argv[1], sys.argv[2].encode(), sys.argv[3], sys.argv[4].upper()
+    count = int(sys.argv[5]) if len(sys.argv) > 5 else 1
+    key = derive_key(keyfile)
+    cmd = cmd.encode().ljust(CMD_SIZE, b'\0')[:CMD_SIZE]
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rtts = []
+
+    for _ in range(count):
+        stamp = int(time.time() * 1000)
+        start = time.perf_counter()
+        sock.sendto(sign(key, device, cmd, stamp), (host, PORT))
+        body = recv_reply(sock, key, device, stamp, start + TIMEOUT)
+        if body is None:
+            print('Timeout')
+            continue
+        rtt = (time.perf_counter() - start) * 1000
+
+        state = body[:CMD_SIZE].rstrip(b'\0').decode()
+        rtts.append(rtt)
+        print('State: %-8s RTT: %.1f ms' % (state, rtt))
+        time.sleep(0.01)
+
+    if rtts:
+        rtts.sort()
+        print('min/median/max: %.1f/%.1f/%.1f ms' % (rtts[0], rtts[len(rtts) // 2], rtts[-1]))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
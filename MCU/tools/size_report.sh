@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# MIT License
+#
+# Copyright (c) 2023 Hoozz <huxiangjs@foxmail.com>
+#
+# Build the default and the release profile, then print the image size,
+# IRAM and DRAM usage of the release build and its difference to the
+# default one.
+#
+# Usage: tools/size_report.sh   (from MCU/, with ESP-IDF exported)
+#
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+idf.py -B build build > /dev/null
+idf.py -B build_release -D SDKCONFIG=build_release/sdkconfig \
+       -D SDKCONFIG_DEFAULTS="sdkconfig;sdkconfig.release" build > /dev/null
+
+for dir in build build_release; do
+	echo "== $dir: $(stat -c %s $dir/esp32c3_remote_switch.bin) bytes"
+done
+
+python "$IDF_PATH/tools/idf_size.py" build_release/esp32c3_remote_switch.map \
+	--diff build/esp32c3_remote_switch.map